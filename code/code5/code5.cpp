@@ -1,52 +1,7 @@
-#include <iostream>
 #include <QtWidgets>
-#include <Eigen/Dense>
-#include <vector>
-#include <assert.h>
-#include <utility> // for std::pair
-#include <memory>
-#include <tuple>
-#include <queue>
-
-const double eps = 1e-3;
-
-using veci = std::vector<int >;
-using vecf = std::vector<float >;
-
-template<class T >
-T pp(T x){
-    return x * x;
-}
-
-template<class T >
-T ppp(T x){
-    return x * x * x;
-}
-
-using Eigen::Matrix4f;
-using Eigen::Matrix4i;
-using Eigen::Vector3f;
-using Eigen::Vector3i;
-using Eigen::Vector4f;
-using Eigen::Vector4i;
-using std::vector;
-
-using std::cout;
-using std::endl;
-
-using Image = vector<vector<Vector4i >>;
-using std::max;
-using std::min;
-using std::pair;
-const Vector4i black(0, 0, 0, 0);
-const Vector4i white(255, 255, 255, 0);
-const Vector4i red(255, 0, 0, 0);
-const Vector4i orange(255, 128, 128, 0);
-const Vector4i blue(0, 0, 255, 0);
-const Vector4i green(30, 255, 0, 0);
-const Vector4i yellow(255, 255, 0, 0);
-
-
+#include "curve_core/render.h"
+#include "curve_core/qt_input.h"
+#include "curve_core/qt_hud.h"
 
 struct Bernstein{
   static double get(int n, int k, double t){
@@ -57,104 +12,8 @@ struct Bernstein{
   }
 };
 
-class Figure{ 
-  
-  virtual std::tuple<veci, veci, vector<Vector4i> > makePaintList(int ww, int hh, int pixelSize) = 0;
-public:
-  virtual ~Figure(){};  // 虚析构函数
-
-  std::tuple<veci, veci, vector<Vector4i> > getPaintList(int ww, int hh, int pixelSize){
-    auto [x, y, c] = makePaintList(ww, hh, pixelSize);
-    assert(x.size() == y.size() && y.size() == c.size());
-
-    for(int & _x : x){
-      _x = max(0, min(ww - 1, _x));
-    }
-    for(int & _y : y){
-      _y = max(0, min(hh - 1, _y));
-    }
-
-    return {x, y, c};
-  }
-};
-
-
-class Line : public Figure{
-  int x0 = 0, x1 = 0, y0 = 0, y1 = 0;
-  Vector4i color = white;
-public:
-  Line(int _x0, int _y0, int _x1, int _y1, Vector4i _color)
-    : x0{_x0}, y0{_y0}, x1{_x1}, y1{_y1}, color{_color} {}
-
-  std::tuple<veci, veci, vector<Vector4i> > makePaintList(int ww, int hh, int pixelSize) override {  
-    veci retx, rety;  
-    vector<Vector4i > retColor;
-    using std::swap;
-    if(abs(x0 - x1) >= abs(y0 - y1)){
-      if(x0 > x1){
-        swap(x0, x1);
-        swap(y0, y1);
-      }
-      int len = x1 - x0 + 1;
-      for(int x = x0; x <= x1; x += pixelSize){
-        int y = (y0 * (x1 - x) + y1 * (x - x0 + 1)) / len;
-        retx.push_back(x);
-        rety.push_back(y);
-        retColor.push_back(color);
-      }
-    }
-    else{
-      if(y0 > y1){
-        swap(x0, x1);
-        swap(y0, y1);
-      }
-      int len = y1 - y0 + 1;
-      for(int y = y0; y <= y1; y += pixelSize){
-        int x = (x0 * (y1 - y) + x1 * (y - y0 + 1)) / len;
-        retx.push_back(x);
-        rety.push_back(y);
-        retColor.push_back(color);
-      }
-    }
-
-    return {retx, rety, retColor};
-  }
-
-  ~Line() override {};
-};
-
-
-class Circle : public Figure{
-  int x = 0, y = 0, r0 = 0, r = 0;
-  Vector4i color = white;
-public:
-  Circle(int _x, int _y, Vector4i _color, int _r, int _r0 = 0)
-    : x{_x}, y{_y}, color{_color}, r{_r}, r0{_r0} {}
-
-  std::tuple<veci, veci, vector<Vector4i> > makePaintList(int ww, int hh, int pixelSize) override { 
-    veci retx, rety;  
-    vector<Vector4i > retColor;
-
-    for(int i = x - r / pixelSize * pixelSize; i <= x + r; i += pixelSize){
-      for(int j = y - r / pixelSize * pixelSize; j <= y + r; j += pixelSize){
-        if(pp(i - x) + pp(j - y) <= pp(r)
-        && pp(i - x) + pp(j - y) >= pp(r0)){
-          retx.push_back(i);
-          rety.push_back(j);
-          retColor.push_back(color);
-          
-        }
-      }
-    }
-
-    return {retx, rety, retColor};
-  }
-  ~Circle() override {};
-};
-
-
 #define circleR 7
-bool same(int x1, int y1, int x2, int y2, int r = circleR){
+bool same(double x1, double y1, double x2, double y2, double r = circleR){
   return std::abs(x1 - x2) <= r && std::abs(y1 - y2) <= r;
 }
 
@@ -168,21 +27,13 @@ struct DeCasteljau{
 };
 
 struct Bezier{
-  static vecf makeBezier(const vecf& x, int NUM){
+  // x 是控制点的一个分量，t 在 [0, 1]，曲线怎么采样由 AdaptiveSampler 决定
+  static double get(const vecf& x, double t){
 
     int n = x.size() - 1;
-    vecf ret;
-    double dt = 1.0 / NUM;
-    ret.reserve(1 / dt + 10);
-
-    for(double t = 0; t < 1 + eps; t += dt){
 /////////////////////////////////////
-// 计算每个点的位置
-      to do
-      ret.push_back(......);
-
-    }
-    return ret;
+// 计算 t 时的位置，使用 DeCasteljau 或者用 Bernstein
+    to do
   }
 };
 
@@ -215,10 +66,11 @@ struct Poly{
     }
   }
 
-  int find(int _x, int _y){
+  // r 是世界坐标下的拾取半径，缩放后要跟着变
+  int find(double _x, double _y, double r = circleR){
     assert(n == x.size());
     for(int i = 0; i < n; i ++){
-      if(same(_x, _y, x[i], y[i])){
+      if(same(_x, _y, x[i], y[i], r)){
         return i;
       }
     }
@@ -227,24 +79,72 @@ struct Poly{
   }
 };
 
+class Board{
+  // 不依赖窗口的部分：参数、画布大小和 drawPoly 都在这里，
+  // MapWidget 和无界面模式（--headless）共用同一份
+public:
+  LayeredScene scene;
+  int ww = 0, hh = 0;
+  Viewport view; // 控制点是世界坐标，画的时候经它换到屏幕上
+  int pixelSize = 3; // 像素大小，1 表示全分辨率抗锯齿
+  Simplifier simplifier; // 采样点变成 Figure 之前先化简，容差不到一个像素格，drawPoly 里跟着 pixelSize 设
+  CurveMemo memo; // 最近算过的曲线，参数调回之前的值时直接拿来用
+
+  void resize(int _ww, int _hh){
+    ww = _ww;
+    hh = _hh;
+  }
+
+  // 曲线都用它采样：弦高不超过半个像素格，画布外面的部分不细分
+  AdaptiveSampler sampler() const {
+    AdaptiveSampler s;
+    s.tol = pixelSize * 0.5;
+    s.ww = ww;
+    s.hh = hh;
+    return s;
+  }
+
+  void drawPoly(const Poly& poly){
+    scene.clear();
+    simplifier.tol = pixelSize * 0.25;
+    // 每层的键是它用到的输入，输入没变的层不重算，直接沿用上次的结果
+    uint64_t points = Hash().add(poly.x).add(poly.y).add(view).add(pixelSize).value();
+    if(poly.n >= 1){
+      uint64_t bezier = Hash().add(points).add(ww).add(hh).value();
+      if(Scene* layer = scene.layer(0, bezier)){
+        auto& curve = memo.get(0, bezier, [&](vecf& xs, vecf& ys){
+          sampler().sample([&](double t){ return view.toScreen(Bezier::get(poly.x, t), Bezier::get(poly.y, t)); }, 0, 1, xs, ys);
+          simplifier.run(xs, ys);
+        });
+        layer -> add<Polyline >(curve.x, curve.y, red);
+      }
+    }
+    if(Scene* layer = scene.layer(1, Hash().add(points).add(ww).add(hh).value())){ // 画布外面的控制点不画，画布大小也算输入
+      view.addCircles(*layer, poly.x, poly.y, red, circleR, ww, hh, pixelSize);
+    }
+
+  }
+};
+
 class MapWidget : public QWidget{
 public:
 
   struct{
-    int x1, y1, x2, y2;
-    void setIn(int _x, int _y){
+    double x1, y1, x2, y2; // 世界坐标
+    void setIn(double _x, double _y){
       x1 = _x;
       y1 = _y;
     }
     
-    void setOut(int _x, int _y){
+    void setOut(double _x, double _y){
       x2 = _x;
       y2 = _y;
     } 
 
-    void update(Poly& poly){
-      int idx1 = poly.find(x1, y1);
-      int idx2 = poly.find(x2, y2);
+    // r 是世界坐标下的拾取半径
+    void update(Poly& poly, double r){
+      int idx1 = poly.find(x1, y1, r);
+      int idx2 = poly.find(x2, y2, r);
       
       if(idx1 != -1){
         if(idx2 == -1){
@@ -270,12 +170,57 @@ public:
   }manageClick;
 
   Poly poly;
-  std::queue<std::shared_ptr<Figure > > onScreen, waitPaint;
+  Board board; // 只存参数，真正画图的是 renderer 计算线程里的那份
+  // 曲线计算和光栅化都在后台线程，算完一帧就回到 GUI 线程按脏区域排一次重绘
+  RenderThread<Board > renderer{[this]{
+    QMetaObject::invokeMethod(this, [this]{ paintIm(); }, Qt::QueuedConnection);
+  }};
+  FramePacer pacer;
+  bool presenting = false; // 新帧已经排了重绘，还没画出来
+  QTimer frameTimer; // 拖拽期间按屏幕刷新率触发 onFrame
+  QTimer resizeTimer; // 改窗口大小停下来以后才按新大小重算
+  QPoint panFrom; // 中键拖动平移时上一次的鼠标位置
+  bool panning = false;
+  InputSession session; // --record / --replay
+  Hud hud{this}; // 按 H 开关的性能面板
+
+  MapWidget(){
+    frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&frameTimer, &QTimer::timeout, this, &MapWidget::onFrame);
+    resizeTimer.setSingleShot(true);
+    resizeTimer.setInterval(150);
+    connect(&resizeTimer, &QTimer::timeout, this, [this]{ renderer.resize(width(), height()); });
+    session.submitted = [this]{ return renderer.submittedCount(); };
+    session.waiting = [this]{ return pacer.waiting() || resizeTimer.isActive(); };
+    session.flush = [this]{
+      onFrame();
+      if(resizeTimer.isActive()){
+        resizeTimer.stop();
+        renderer.resize(width(), height());
+      }
+    };
+  }
 
   void paintIm(){
-    // 立即重绘
-    update();
-    qApp->processEvents();
+    // 换上计算线程新算完的帧，只重绘和上一帧相比变了的区域；
+    // 帧还没算完就什么都不做，算完时计算线程会再调一次
+    if(!renderer.acquire()){
+      return;
+    }
+    QRegion region;
+    for(auto& rect : renderer.dirty()){
+      region += QRect(rect.x0, rect.y0, rect.x1 - rect.x0, rect.y1 - rect.y0);
+    }
+    if(hud.visible()){
+      region += hud.rect(); // 面板跟着每一帧刷新
+    }
+    if(region.isEmpty()){
+      pacer.presented(); // 画面没变，不用重绘
+      session.presented(*renderer.latest(), 0);
+      return;
+    }
+    presenting = true;
+    update(region);
   }
 
 protected:
@@ -283,18 +228,59 @@ protected:
     return QColor(color.x(), color.y(), color.z());
   }
 
+  // 鼠标位置换成世界坐标
+  Vector2d toWorld(const QPoint& pos) const {
+    return board.view.toWorld(pos.x(), pos.y());
+  }
+
+  // 控制点的拾取半径，不管怎么缩放，屏幕上都是 circleR 个像素
+  double pickR() const {
+    return circleR / board.view.scale;
+  }
+
   void mousePressEvent(QMouseEvent *event) override {
-    QPoint clickPosition = event->pos();  
-    int clickX = clickPosition.x();
-    int clickY = clickPosition.y();
+    if(event->button() == Qt::MiddleButton){
+      panFrom = event->pos();
+      panning = true;
+      return;
+    }
+    Vector2d clickPosition = toWorld(event->pos());
+    double clickX = clickPosition.x();
+    double clickY = clickPosition.y();
     manageClick.setIn(clickX, clickY);
+    frameTimer.start(frameInterval());
   }
 
   void mouseMoveEvent(QMouseEvent * event) override{
-    QPoint clickPosition = event->pos();  
-    int clickX = clickPosition.x();
-    int clickY = clickPosition.y();
-    int t1 = poly.find(manageClick.x1, manageClick.y1);  
+    if(panning){
+      board.view.pan(event->pos().x() - panFrom.x(), event->pos().y() - panFrom.y());
+      panFrom = event->pos();
+      redraw();
+      return;
+    }
+    // 只记下最新位置，重算留给 onFrame，一帧最多算一次
+    pacer.push(event->pos().x(), event->pos().y());
+  }
+
+  void wheelEvent(QWheelEvent *event) override {
+    // 滚轮以鼠标所在的点为中心缩放，一格 1.25 倍
+    board.view.zoom(std::pow(1.25, event->angleDelta().y() / 120.0), event->position().x(), event->position().y());
+    redraw();
+  }
+
+  // 视图变了，控制点不变，按新的视图重画
+  void redraw(){
+    drawPoly(poly);
+  }
+
+  void onFrame(){
+    int sx, sy;
+    if(!pacer.take(sx, sy)){
+      return;
+    }
+    Vector2d click = toWorld(QPoint(sx, sy));
+    double clickX = click.x(), clickY = click.y();
+    int t1 = poly.find(manageClick.x1, manageClick.y1, pickR());  
     if(t1 != -1){
       auto tmpPoly = poly;
       tmpPoly.x[t1] = clickX;
@@ -304,53 +290,93 @@ protected:
   }
 
   void mouseReleaseEvent(QMouseEvent *event) override {
-    QPoint clickPosition = event->pos();  
-    int clickX = clickPosition.x();
-    int clickY = clickPosition.y();
+    if(event->button() == Qt::MiddleButton){
+      panning = false;
+      return;
+    }
+    Vector2d clickPosition = toWorld(event->pos());
+    double clickX = clickPosition.x();
+    double clickY = clickPosition.y();
 
     manageClick.setOut(clickX, clickY);
-    manageClick.update(poly);
+    manageClick.update(poly, pickR());
     drawPoly(poly);
+    frameTimer.stop();
+    pacer.report();
   }
   
   void drawPoly(const Poly& poly){
-    const int NUM = 1e3;
-    auto x = Bezier::makeBezier(poly.x, NUM);
-    auto y = Bezier::makeBezier(poly.y, NUM);
+    // 控制点和参数拷一份交给计算线程，GUI 线程不等它算完
+    renderer.submit([poly, view = board.view, pixelSize = board.pixelSize](Board& b){
+      b.view = view;
+      b.pixelSize = pixelSize;
+      b.drawPoly(poly);
+    }, size().width(), size().height());
+    paintIm();
+  }
 
-    for(int i = 1; i < NUM; i ++){
-      waitPaint.push(std::make_shared<Line > (x[i - 1], y[i - 1], x[i], y[i], red));
-    }
-    for(int i = 0; i < poly.n; i ++){
-      waitPaint.push(std::make_shared<Circle >(poly.x[i], poly.y[i], red, circleR));  
-    }
+  // 一帧的毫秒数，拿不到刷新率时按 60Hz 算
+  static int frameInterval(){
+    QScreen* screen = QGuiApplication::primaryScreen();
+    double hz = screen ? screen->refreshRate() : 0;
+    return hz > 1 ? max(1, int(1000 / hz)) : 16;
+  }
 
-    paintIm();
+  // 拖着窗口边改大小时每一步都按新大小重算、重新分配画布，窗口大到 4K 时计算线程会一直追不上；
+  // 这期间只重启定时器，paintEvent 照旧贴上一帧，停下来 150ms 以后按最终的大小重算一次
+  void resizeEvent([[maybe_unused]] QResizeEvent *event) override {
+    resizeTimer.start();
+  }
+
+  // 收到的输入事件先给 session，录制时记下来
+  bool event(QEvent *event) override {
+    session.record(event);
+    return QWidget::event(event);
   }
 
   void paintEvent(QPaintEvent *event) override{
-  
-    Q_UNUSED(event);
+    TraceSpan span("paintEvent");
+    auto begin = std::chrono::steady_clock::now();
+    bool fresh = presenting;
+    if(presenting){
+      presenting = false;
+      pacer.presented();
+    }
+    auto frame = renderer.latest();
+    if(frame == nullptr){
+      return;
+    }
 
+    // 只贴要重绘的区域：新帧是 paintIm 给的脏区域，窗口被遮挡、改大小时是 Qt 给的区域
+    // QImage 只是包一层画布的内存，不拷贝
+    // 改大小还没重算完时帧和窗口不一样大，照样贴在左上角：视图的左上角和缩放不随窗口变，
+    // 重算以后已有的部分还在原来的位置，新露出来的地方先露着背景
+    const Canvas& canvas = frame -> canvas;
+    QImage image(reinterpret_cast<const uchar* >(canvas.data()),
+      canvas.width(), canvas.height(), canvas.width() * 4, QImage::Format_ARGB32_Premultiplied);
     QPainter painter(this);
-    int ww = size().width();
-    int hh = size().height();
-
-    while(waitPaint.empty() == false){
-      auto [x, y, c] = waitPaint.front() -> getPaintList(ww, hh, pixelSize);
-      int n = x.size();
-      for(int i = 0; i < n; i ++){
-        painter.setBrush(QColor(c[i].x(), c[i].y(), c[i].z()));
-        painter.drawRect(x[i], y[i], pixelSize, pixelSize);
-      }
-
-      onScreen.push(waitPaint.front());
-      waitPaint.pop();
+    for(const QRect& rect : event -> region()){
+      painter.drawImage(rect.topLeft(), image, rect);
+    }
+    double paintMs = std::chrono::duration<double, std::milli >(std::chrono::steady_clock::now() - begin).count();
+    if(fresh){
+      Trace::flow("job", 'f', frame -> seq); // 计算线程算的这一帧贴出来了
+      session.presented(*frame, paintMs);
+      hud.presented(*frame, paintMs);
     }
+    hud.draw(painter);
   }
 
-private:
-  static constexpr int pixelSize = 3; // 像素大小
+  void keyPressEvent(QKeyEvent *event) override {
+    if(event -> key() == Qt::Key_A){
+      // 在 3 像素的方块和全分辨率抗锯齿之间切换
+      board.pixelSize = board.pixelSize == 1 ? 3 : 1;
+      redraw();
+    }
+    else if(event -> key() == Qt::Key_H){
+      hud.toggle();
+    }
+  }
 };
 
 int getRand(int l, int r){
@@ -358,12 +384,23 @@ int getRand(int l, int r){
 }
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
+  TraceSession trace(argc, argv); // --trace out.json：退出时把各线程的 trace 写进去，放在最前面，最后析构
   
+  if(argc > 1 && std::string(argv[1]) == "--bench-line"){
+    return LineBench::run();
+  }
+  if(argc > 1 && std::string(argv[1]) == "--headless"){
+    return Headless::run<Board, Poly >(argc, argv);
+  }
+
   QApplication app(argc, argv);
   MapWidget mapWidget;
   const int WW = 2000, HH = 1000;
   mapWidget.resize(WW, HH);
   mapWidget.show();
+  if(!mapWidget.session.start(&mapWidget, argc, argv)){
+    return 1;
+  }
 
 
   return app.exec();
@@ -0,0 +1,532 @@
+// 曲线算法的微基准，不需要 Qt：每个内核在 4 ~ 1e6 个点上各跑一遍，结果以 JSON 打到标准输出，
+// 包括每个 (内核, 点数) 的 ns/op、每个 op 的内存分配次数，以及按点数拟合出来的复杂度指数。
+//   curve_bench [--max-n 1000000] [--min-ms 10] [--repeat 5] [--filter 名字里的一段] [--baseline old.json] [--tolerance 0.25] [--noise-ns 20]
+// 整套测 repeat 遍，每遍每项至少跑 min-ms；ns_per_op 取各遍里最快的一次（别的进程、降频只会让它变慢），中位数另外记下来。
+// 各遍隔开一整套的时间，机器慢上好几秒也只影响其中一遍
+// 给了 --baseline 就逐项和以前存下来的结果比，最快的和中位数都慢了超过 tolerance、而且多出来的超过 noise-ns，
+// 单独再测几轮还是这样，或者分配变多了，就列出来并返回 1，可以用来卡性能回退。noise-ns 管的是一次只要几十纳秒的项，抖几纳秒就是好几成
+// 复杂度高的内核点数太多时一次就要很久，单次超过 0.1 秒就不再往上加点数
+#include "curve_math/math.h"
+
+// 从进程开始到现在的内存分配次数
+static std::atomic<long > allocCount{0};
+
+#if defined(__GLIBC__)
+// glibc 下直接接管 malloc 一族：Eigen 的矩阵用 std::malloc 分配，operator new 最后也走到这里
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size) noexcept {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) noexcept {
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(p, size);
+}
+
+void free(void* p) noexcept {
+  __libc_free(p);
+}
+}
+#else
+// 其他平台只数 operator new，Eigen 矩阵的分配数不到
+void* operator new(size_t size){
+  allocCount.fetch_add(1, std::memory_order_relaxed);
+  if(void* p = std::malloc(size ? size : 1)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+#endif
+
+static volatile double sink; // 结果都加到这里，免得被编译器优化掉
+
+struct Kernel{
+  // prepare(n) 准备好 n 个点的输入，返回跑一次的函数，它的返回值是这一次做了几个 op
+  using Run = std::function<long()>;
+  std::string name;
+  int maxN; // 这个内核最多测到多少个点（内存或者时间不允许再多）
+  std::function<Run(int)> prepare;
+};
+
+struct Result{
+  std::string kernel;
+  int n;
+  long ops;
+  double nsPerOp, allocsPerOp; // nsPerOp 是最快一轮的
+  double nsMedian = 0; // 各轮的中位数，和基线比时也要一起变慢才算
+};
+
+// [0, 1] 上的 n 个点：切比雪夫点（拉格朗日插值在上面不会发散）或者等距点
+static vector<double > nodes(int n, bool chebyshev){
+  vector<double > x(n);
+  for(int i = 0; i < n; i ++){
+    x[i] = chebyshev ? 0.5 - 0.5 * std::cos(M_PI * (2 * i + 1) / (2 * n)) : double(i) / max(n - 1, 1);
+  }
+  return x;
+}
+
+static vecf wave(int n){
+  vecf y(n);
+  for(int i = 0; i < n; i ++){
+    y[i] = std::sin(i * 0.7) * 100;
+  }
+  return y;
+}
+
+// 成批求值一次给多少个 t：代价和点数成正比的给 256 个，和点数平方成正比的少给一些，单次别太久
+static int batchSize(int n, bool quadratic){
+  long long cost = quadratic ? (long long)n * n : n;
+  return int(std::clamp((1ll << 22) / max(cost, 1ll), 1ll, 256ll));
+}
+
+static vector<double > params(int count){
+  vector<double > t(count);
+  for(int i = 0; i < count; i ++){
+    t[i] = (i + 0.5) / count;
+  }
+  return t;
+}
+
+static vector<Kernel > kernels(){
+  vector<Kernel > list;
+
+  list.push_back({"lagrange_eval", 1 << 20, [](int n){
+    auto x = nodes(n, true);
+    vecf w = wave(n);
+    vector<double > y(w.begin(), w.end());
+    auto t = params(batchSize(n, true));
+    auto out = std::make_shared<vector<double > >();
+    return Kernel::Run([=]{
+      Interpolation::lagrange(x, y, t, *out);
+      sink = sink + out -> back();
+      return long(t.size());
+    });
+  }});
+
+  list.push_back({"gauss_solve", 1024, [](int n){
+    vector<double > x(n), y(n);
+    for(int i = 0; i < n; i ++){
+      x[i] = i;
+      y[i] = std::sin(i * 0.7) * 100;
+    }
+    return Kernel::Run([=]{
+      sink = sink + Interpolation::gaussFit(x, y, 1.0).back();
+      return 1l;
+    });
+  }});
+
+  list.push_back({"gauss_eval", 1 << 20, [](int n){
+    vector<double > x(n), b(n);
+    for(int i = 0; i < n; i ++){
+      x[i] = i;
+      b[i] = std::sin(i * 0.7);
+    }
+    auto t = params(batchSize(n, false));
+    for(auto& v : t){
+      v *= n;
+    }
+    auto out = std::make_shared<vector<double > >();
+    return Kernel::Run([=]{
+      Interpolation::getGauss(x, b, 1.0, t, *out);
+      sink = sink + out -> back();
+      return long(t.size());
+    });
+  }});
+
+  list.push_back({"polynomial_fit", 1 << 20, [](int n){
+    auto x = nodes(n, false);
+    vector<double > y(n);
+    for(int i = 0; i < n; i ++){
+      y[i] = std::sin(x[i] * 6);
+    }
+    return Kernel::Run([=]{
+      sink = sink + Interpolation::polynomialFit(x, y, 8, 1e-3).back();
+      return 1l;
+    });
+  }});
+
+  list.push_back({"parameterization_distance", 1 << 20, [](int n){
+    vecf x(n), y = wave(n);
+    for(int i = 0; i < n; i ++){
+      x[i] = i;
+    }
+    return Kernel::Run([=]{
+      sink = sink + Parameterization::distance(x, y).back();
+      return 1l;
+    });
+  }});
+
+  list.push_back({"parameterization_average", 1 << 20, [](int n){
+    vecf x(n), y = wave(n);
+    return Kernel::Run([=]{
+      sink = sink + Parameterization::average(x, y).back();
+      return 1l;
+    });
+  }});
+
+  list.push_back({"b3_solve", 1 << 20, [](int n){
+    auto b3 = std::make_shared<B3 >();
+    auto x = nodes(n, false);
+    b3 -> x.assign(x.begin(), x.end());
+    b3 -> y = wave(n);
+    return Kernel::Run([=]{
+      b3 -> getB3();
+      sink = sink + b3 -> a.back();
+      return 1l;
+    });
+  }});
+
+  list.push_back({"b3_eval", 1 << 20, [](int n){
+    auto b3 = std::make_shared<B3 >();
+    auto x = nodes(n, false);
+    b3 -> x.assign(x.begin(), x.end());
+    b3 -> y = wave(n);
+    b3 -> getB3();
+    auto t = params(batchSize(n, false));
+    auto out = std::make_shared<vector<double > >();
+    return Kernel::Run([=]{
+      b3 -> get(t, *out);
+      sink = sink + out -> back();
+      return long(t.size());
+    });
+  }});
+
+  list.push_back({"de_casteljau", 1 << 20, [](int n){
+    vecf x = wave(n);
+    auto t = params(batchSize(n, true));
+    auto out = std::make_shared<vector<double > >();
+    auto scratch = std::make_shared<vecf >();
+    return Kernel::Run([=]{
+      DeCasteljau::get(x, t, *out, *scratch);
+      sink = sink + out -> back();
+      return long(t.size());
+    });
+  }});
+
+  // 组合数用 double 的杨辉三角，n 过了 1029 会变成 inf，点数到 1024 为止
+  list.push_back({"bernstein", 1024, [](int n){
+    vecf x = wave(n);
+    C::set(n - 1);
+    auto t = params(batchSize(n, false));
+    return Kernel::Run([=]{
+      double sum = 0;
+      for(double s : t){
+        for(int k = 0; k < n; k ++){
+          sum += Bernstein::get(n - 1, k, s) * x[k];
+        }
+      }
+      sink = sink + sum;
+      return long(t.size());
+    });
+  }});
+
+  list.push_back({"bspline_nvec", 1 << 20, [](int n){
+    auto t = params(batchSize(n, false));
+    return Kernel::Run([=]{
+      double sum = 0;
+      for(double s : t){
+        sum += B_spline::getNvec(4, s, n).back();
+      }
+      sink = sink + sum;
+      return long(t.size());
+    });
+  }});
+
+  list.push_back({"bspline_eval", 1 << 20, [](int n){
+    vecf x = wave(n);
+    auto t = params(batchSize(n, false));
+    auto out = std::make_shared<vector<double > >();
+    return Kernel::Run([=]{
+      B_spline::get(x, 4, t, *out);
+      sink = sink + out -> back();
+      return long(t.size());
+    });
+  }});
+
+  auto subdivision = [](vecf (*make)(const vecf&, int)){
+    return [make](int n){
+      vecf v = wave(n);
+      return Kernel::Run([=]{
+        sink = sink + make(v, 1).back();
+        return 1l;
+      });
+    };
+  };
+  list.push_back({"subdivision_2b", 1 << 20, subdivision(CurveSubdivision::make2B)});
+  list.push_back({"subdivision_3b", 1 << 20, subdivision(CurveSubdivision::make3B)});
+  list.push_back({"subdivision_4f", 1 << 20, subdivision(CurveSubdivision::make4F)});
+  return list;
+}
+
+// 先跑一次预热，然后一直跑到总时间超过 minMs；返回单次最长的秒数，用来决定还要不要加点数
+// 预热的那次不数分配，一次性的分配（比如输出第一次扩容）不算在每个 op 上
+static double measure(const Kernel& kernel, int n, double minMs, Result& result){
+  using clock = std::chrono::steady_clock;
+  Kernel::Run run = kernel.prepare(n);
+  auto begin = clock::now();
+  run();
+  double slowest = std::chrono::duration<double >(clock::now() - begin).count();
+
+  long ops = 0, calls = 0;
+  long allocs = allocCount.load();
+  begin = clock::now();
+  double elapsed = 0;
+  while(calls == 0 || elapsed * 1e3 < minMs){
+    auto start = clock::now();
+    ops += run();
+    calls ++;
+    auto end = clock::now();
+    slowest = max(slowest, std::chrono::duration<double >(end - start).count());
+    elapsed = std::chrono::duration<double >(end - begin).count();
+  }
+  allocs = allocCount.load() - allocs; // 先数完再拷名字，名字长了拷一次也要分配
+  result = {kernel.name, n, ops, elapsed * 1e9 / ops, double(allocs) / ops};
+  return slowest;
+}
+
+// log(ns/op) 对 log(n) 的最小二乘斜率；n 太小时固定开销占大头，够用的话只取 n >= 64 的
+static double exponent(const vector<Result >& runs, int& fromN, int& toN){
+  vector<const Result* > used;
+  for(auto& r : runs){
+    if(r.n >= 64){
+      used.push_back(&r);
+    }
+  }
+  if(used.size() < 2){
+    used.clear();
+    for(auto& r : runs){
+      used.push_back(&r);
+    }
+  }
+  fromN = used.front() -> n;
+  toN = used.back() -> n;
+  if(used.size() < 2){
+    return 0;
+  }
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, m = used.size();
+  for(auto r : used){
+    double lx = std::log(double(r -> n)), ly = std::log(r -> nsPerOp);
+    sx += lx;
+    sy += ly;
+    sxx += lx * lx;
+    sxy += lx * ly;
+  }
+  return (m * sxy - sx * sy) / (m * sxx - sx * sx);
+}
+
+// 只认自己输出的格式：每个结果单独一行
+static vector<Result > loadBaseline(const std::string& path){
+  vector<Result > results;
+  std::ifstream in(path);
+  std::string line;
+  while(std::getline(in, line)){
+    char name[64];
+    Result r;
+    if(std::sscanf(line.c_str(), " {\"kernel\": \"%63[^\"]\", \"n\": %d, \"ops\": %ld, \"ns_per_op\": %lf, \"allocs_per_op\": %lf",
+        name, &r.n, &r.ops, &r.nsPerOp, &r.allocsPerOp) == 5){
+      r.kernel = name;
+      // 老的结果文件没有中位数，就拿最快的顶上
+      const char* median = std::strstr(line.c_str(), "\"ns_median\":");
+      if(!median || std::sscanf(median, "\"ns_median\": %lf", &r.nsMedian) != 1){
+        r.nsMedian = r.nsPerOp;
+      }
+      results.push_back(r);
+    }
+  }
+  return results;
+}
+
+int main(int argc, char** argv){
+  int maxN = 1000000, repeat = 5;
+  double minMs = 10, tolerance = 0.25, noiseNs = 20;
+  std::string filter, baselinePath;
+  for(int i = 1; i < argc; i ++){
+    std::string arg = argv[i];
+    if(arg == "--max-n" && i + 1 < argc){
+      maxN = std::atoi(argv[++ i]);
+    }
+    else if(arg == "--min-ms" && i + 1 < argc){
+      minMs = std::atof(argv[++ i]);
+    }
+    else if(arg == "--repeat" && i + 1 < argc){
+      repeat = std::atoi(argv[++ i]);
+    }
+    else if(arg == "--filter" && i + 1 < argc){
+      filter = argv[++ i];
+    }
+    else if(arg == "--baseline" && i + 1 < argc){
+      baselinePath = argv[++ i];
+    }
+    else if(arg == "--tolerance" && i + 1 < argc){
+      tolerance = std::atof(argv[++ i]);
+    }
+    else if(arg == "--noise-ns" && i + 1 < argc){
+      noiseNs = std::atof(argv[++ i]);
+    }
+    else{
+      std::cerr << "usage: " << argv[0] << " [--max-n 1000000] [--min-ms 10] [--repeat 5] [--filter NAME] [--baseline old.json] [--tolerance 0.25] [--noise-ns 20]" << endl;
+      return 1;
+    }
+  }
+  if(maxN < 4 || !(minMs >= 0) || repeat < 1){
+    std::cerr << "bad --max-n, --min-ms or --repeat" << endl;
+    return 1;
+  }
+
+  // 第一遍定下每个内核测哪些点数，后面几遍照着重测
+  auto list = kernels();
+  vector<Result > results;
+  vector<int > owner; // results[i] 是 list[owner[i]] 的
+  for(int i = 0; i < int(list.size()); i ++){
+    auto& kernel = list[i];
+    if(kernel.name.find(filter) == std::string::npos){
+      continue;
+    }
+    // 4, 16, 64, ... 一直到上限，最后补上上限本身
+    int limit = min(kernel.maxN, maxN);
+    vector<int > sizes;
+    for(long long n = 4; n <= limit; n *= 4){
+      sizes.push_back(n);
+    }
+    if(sizes.back() != limit){
+      sizes.push_back(limit);
+    }
+    for(int n : sizes){
+      Result r;
+      double slowest = measure(kernel, n, minMs, r);
+      results.push_back(r);
+      owner.push_back(i);
+      std::cerr << kernel.name << " n=" << n << ": " << r.nsPerOp << " ns/op" << endl;
+      if(slowest > 0.1){
+        break;
+      }
+    }
+  }
+  vector<vector<double > > rounds(results.size()); // 每项各遍的 ns/op
+  for(int pass = 0; pass < repeat; pass ++){
+    if(pass > 0){
+      std::cerr << "pass " << pass + 1 << "/" << repeat << endl;
+    }
+    for(size_t i = 0; i < results.size(); i ++){
+      Result r = results[i];
+      if(pass > 0){
+        measure(list[owner[i]], r.n, minMs, r);
+        results[i].ops += r.ops;
+        results[i].allocsPerOp = min(results[i].allocsPerOp, r.allocsPerOp);
+      }
+      rounds[i].push_back(r.nsPerOp);
+    }
+  }
+  auto summarize = [&](size_t i){
+    std::sort(rounds[i].begin(), rounds[i].end());
+    results[i].nsPerOp = rounds[i].front();
+    results[i].nsMedian = rounds[i][rounds[i].size() / 2];
+  };
+  for(size_t i = 0; i < results.size(); i ++){
+    summarize(i);
+  }
+
+  // 和基线比。最快的和中位数都慢了才算慢：基线里碰巧特别快的一轮只拉低最快的那个，真变慢了两个都会跟着变。
+  // 看着变慢的项不马上认定，先一起再测 repeat 轮，每轮把还没过的挨个测一遍并进各轮的结果里，
+  // 一直慢的才算回退：机器慢起来往往连着好几秒，隔开一轮再测才分得开
+  int regressions = 0, compared = 0;
+  if(!baselinePath.empty()){
+    auto baseline = loadBaseline(baselinePath);
+    if(baseline.empty()){
+      std::cerr << "no results in " << baselinePath << endl;
+      return 1;
+    }
+    auto slower = [&](double now, double before){
+      return now > before * (1 + tolerance) && now - before > noiseNs;
+    };
+    auto worse = [&](const Result& r, const Result& old){
+      return (slower(r.nsPerOp, old.nsPerOp) && slower(r.nsMedian, old.nsMedian)) || r.allocsPerOp > old.allocsPerOp + 0.01;
+    };
+    vector<std::pair<size_t, Result > > suspects; // (results 里的下标, 基线)
+    for(auto& old : baseline){
+      for(size_t i = 0; i < results.size(); i ++){
+        if(results[i].kernel != old.kernel || results[i].n != old.n){
+          continue;
+        }
+        compared ++;
+        if(worse(results[i], old)){
+          suspects.emplace_back(i, old);
+        }
+      }
+    }
+    for(int pass = 0; pass < repeat && !suspects.empty(); pass ++){
+      std::cerr << "recheck " << pass + 1 << "/" << repeat << ": " << suspects.size() << " slower than baseline" << endl;
+      vector<std::pair<size_t, Result > > still;
+      for(auto& [i, old] : suspects){
+        auto& r = results[i];
+        Result again;
+        measure(list[owner[i]], r.n, minMs, again);
+        r.ops += again.ops;
+        r.allocsPerOp = min(r.allocsPerOp, again.allocsPerOp);
+        rounds[i].push_back(again.nsPerOp);
+        summarize(i);
+        if(worse(r, old)){
+          still.emplace_back(i, old);
+        }
+      }
+      suspects.swap(still);
+    }
+    for(auto& [i, old] : suspects){
+      auto& r = results[i];
+      regressions ++;
+      std::cerr << "regression: " << r.kernel << " n=" << r.n << ": " << old.nsPerOp << " -> " << r.nsPerOp << " ns/op, "
+        << old.allocsPerOp << " -> " << r.allocsPerOp << " allocs/op" << endl;
+    }
+  }
+
+  vector<std::tuple<std::string, double, int, int > > scaling;
+  for(size_t i = 0; i < results.size(); ){
+    size_t end = i;
+    while(end < results.size() && owner[end] == owner[i]){
+      end ++;
+    }
+    vector<Result > runs(results.begin() + i, results.begin() + end);
+    int fromN, toN;
+    double k = exponent(runs, fromN, toN);
+    scaling.emplace_back(list[owner[i]].name, k, fromN, toN);
+    i = end;
+  }
+
+  printf("{\n  \"benchmarks\": [\n");
+  for(size_t i = 0; i < results.size(); i ++){
+    auto& r = results[i];
+    printf("    {\"kernel\": \"%s\", \"n\": %d, \"ops\": %ld, \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f, \"ns_median\": %.3f, \"repeat\": %d}%s\n",
+      r.kernel.c_str(), r.n, r.ops, r.nsPerOp, r.allocsPerOp, r.nsMedian, int(rounds[i].size()), i + 1 < results.size() ? "," : "");
+  }
+  printf("  ],\n  \"scaling\": [\n");
+  for(size_t i = 0; i < scaling.size(); i ++){
+    auto& [name, k, fromN, toN] = scaling[i];
+    printf("    {\"kernel\": \"%s\", \"exponent\": %.3f, \"from_n\": %d, \"to_n\": %d}%s\n",
+      name.c_str(), k, fromN, toN, i + 1 < scaling.size() ? "," : "");
+  }
+  printf("  ]\n}\n");
+
+  if(!baselinePath.empty()){
+    std::cerr << compared << " compared with " << baselinePath << ", " << regressions << " regressions" << endl;
+  }
+  return regressions ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+// 性能面板上每帧的内存分配次数：替换全局的 operator new / delete，流水线线程（Profiler::pipelineThread）每次 new 给 Profiler::allocs 加一。
+// 全局的替换一个程序只能有一份，所以单独放在这个 .cpp 里，由 common/CMakeLists.txt 的 curve_alloc_count
+// 在 CURVE_COUNT_ALLOCS 打开时编进 code1 ~ code7。面板关着（Profiler::enabled 为 false）时只多读一次原子变量。
+// Eigen 的矩阵直接用 malloc，不经过这里，数不到
+#include "curve_core/render.h"
+#include <cstdlib>
+#include <new>
+
+static void count(){
+  if(Profiler::enabled.load(std::memory_order_relaxed) && Profiler::pipelineThread){
+    Profiler::allocs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void* operator new(size_t size){
+  count();
+  if(void* p = std::malloc(size ? size : 1)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size){
+  return operator new(size);
+}
+
+// FrameArena 的块是按对齐要求 new 的，也要数
+void* operator new(size_t size, std::align_val_t align){
+  count();
+  size_t a = size_t(align);
+  if(void* p = std::aligned_alloc(a, (max(size, size_t(1)) + a - 1) / a * a)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align){
+  return operator new(size, align);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
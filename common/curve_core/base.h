@@ -0,0 +1,68 @@
+#pragma once
+// code1 ~ code7 共用的基础定义：标准库、Eigen、vecf / veci、pp / ppp 和几种颜色，不依赖 Qt
+#include <iostream>
+#include <Eigen/Dense>
+#include <vector>
+#include <assert.h>
+#include <utility>
+#include <memory>
+#include <tuple>
+#include <cstdint>
+#include <algorithm>
+#include <memory_resource>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <array>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <cstring>
+
+const double eps = 1e-3;
+
+using veci = std::vector<int >;
+using vecf = std::vector<float >;
+
+template<class T >
+T pp(T x){
+    return x * x;
+}
+
+template<class T >
+T ppp(T x){
+    return x * x * x;
+}
+
+using Eigen::Matrix4f;
+using Eigen::Matrix4i;
+using Eigen::Vector2d;
+using Eigen::Vector3f;
+using Eigen::Vector3i;
+using Eigen::Vector4f;
+using Eigen::Vector4i;
+using std::vector;
+
+using std::cout;
+using std::endl;
+
+using Image = vector<vector<Vector4i >>;
+using std::max;
+using std::min;
+using std::pair;
+const Vector4i black(0, 0, 0, 0);
+const Vector4i white(255, 255, 255, 0);
+const Vector4i red(255, 0, 0, 0);
+const Vector4i orange(255, 128, 128, 0);
+const Vector4i blue(0, 0, 255, 0);
+const Vector4i green(30, 255, 0, 0);
+const Vector4i yellow(255, 255, 0, 0);
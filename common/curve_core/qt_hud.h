@@ -0,0 +1,137 @@
+#pragma once
+// 性能面板，要 Qt，只给 code1 ~ code7 的窗口用。
+#include <QtWidgets>
+#include <deque>
+#include "curve_core/render.h"
+
+class Hud{
+  // 窗口左上角的性能面板，按 H 开关：FPS，每帧各阶段的用时（最近一帧、最近 240 帧的 p50 / p99 和直方图），
+  // Figure 数、像素数，每帧的内存分配次数（计算线程和光栅化工作线程里的，由计算线程记在帧上，
+  // 面板自己和贴图的分配不算在里面；要编进 alloc_count.cpp 才有）。
+  // 开着的时候才让 ScopedTimer 计时，关着没有额外开销；每帧换上来时调 presented，paintEvent 最后调 draw
+public:
+  using clock = std::chrono::steady_clock;
+
+  explicit Hud(QWidget* _widget) : widget{_widget} {
+    // 没有新帧的时候也要把 FPS 降下来
+    QObject::connect(&refresh, &QTimer::timeout, [this]{ widget -> update(rect()); });
+  }
+
+  bool visible() const { return shown; }
+
+  void toggle(){
+    shown = !shown;
+    Profiler::enabled = shown;
+    if(shown){
+      refresh.start(500);
+    }
+    else{
+      refresh.stop();
+    }
+    widget -> update(rect());
+  }
+
+  // 面板占的区域，开着的时候每一帧都要重画这块
+  QRect rect() const {
+    return QRect(margin, margin, panelW, (rowNum + 1) * lineH);
+  }
+
+  template<class Frame >
+  void presented(const Frame& frame, double paintMs){
+    if(!shown){
+      return;
+    }
+    times.push_back(clock::now());
+    compute.push(frame.computeMs);
+    raster.push(frame.rasterMs);
+    paint.push(paintMs);
+    double other = frame.computeMs;
+    for(int i = 0; i < Profiler::StageNum; i ++){
+      stages[i].push(frame.stageMs[i]);
+      if(i <= Profiler::Simplify){
+        other -= frame.stageMs[i];
+      }
+    }
+    rest.push(max(other, 0.0));
+    figures = frame.figures;
+    pixels = frame.pixels;
+    allocsPerFrame.push(frame.allocs);
+  }
+
+  void draw(QPainter& painter){
+    if(!shown){
+      return;
+    }
+    auto now = clock::now();
+    while(!times.empty() && now - times.front() > std::chrono::seconds(1)){
+      times.pop_front();
+    }
+
+    painter.fillRect(rect(), QColor(0, 0, 0, 180));
+    QFont font;
+    font.setFamily("monospace");
+    font.setStyleHint(QFont::Monospace);
+    font.setPointSize(9);
+    painter.setFont(font);
+    painter.setPen(QColor(255, 255, 255));
+
+    int row = 0;
+    char text[128];
+    auto line = [&](const char* s){
+      lineText = QLatin1String(s); // 容量够时不重新分配
+      painter.drawText(margin + 6, margin + lineH * ++ row, lineText);
+    };
+    auto stage = [&](const char* name, const RollingHistogram& h){
+      std::snprintf(text, sizeof(text), "%-12s %7.2f %7.2f %7.2f", name, h.last(), h.percentile(0.5), h.percentile(0.99));
+      line(text);
+      // 直方图：每个桶一根柱子，高度按这一行最多的桶归一
+      auto& buckets = h.buckets();
+      int most = max(1, *std::max_element(buckets.begin(), buckets.end()));
+      for(int i = 0; i < RollingHistogram::bucketNum; i ++){
+        int bar = (lineH - 4) * buckets[i] / most;
+        painter.fillRect(margin + histX + i * 5, margin + lineH * row - bar, 4, bar, QColor(120, 200, 255));
+      }
+    };
+
+    std::snprintf(text, sizeof(text), "%zu fps", times.size());
+    line(text);
+    std::snprintf(text, sizeof(text), "%-12s %7s %7s %7s  0.1ms..32ms", "ms", "last", "p50", "p99");
+    line(text);
+    stage("compute", compute);
+    char name[32];
+    for(int i = Profiler::Solve; i <= Profiler::Simplify; i ++){
+      std::snprintf(name, sizeof(name), "  %s", Profiler::names[i]);
+      stage(name, stages[i]);
+    }
+    stage("  other", rest);
+    stage("raster", raster);
+    for(int i = Profiler::Prepare; i <= Profiler::Composite; i ++){
+      std::snprintf(name, sizeof(name), "  %s", Profiler::names[i]);
+      stage(name, stages[i]);
+    }
+    stage("paint", paint);
+    std::snprintf(text, sizeof(text), "%zu figures, %ld pixels", figures, pixels);
+    line(text);
+#ifdef CURVE_COUNT_ALLOCS
+    std::snprintf(text, sizeof(text), "allocs/frame %ld, p50 %.0f, p99 %.0f",
+      long(allocsPerFrame.last()), allocsPerFrame.percentile(0.5), allocsPerFrame.percentile(0.99));
+#else
+    std::snprintf(text, sizeof(text), "allocs/frame not counted (CURVE_COUNT_ALLOCS=OFF)");
+#endif
+    line(text);
+  }
+
+private:
+  static constexpr int margin = 8, lineH = 15, panelW = 380, histX = 300;
+  static constexpr int rowNum = 13; // draw 里画的行数
+
+  QWidget* widget;
+  bool shown = false;
+  QTimer refresh;
+  std::deque<clock::time_point > times; // 最近一秒内换上来的帧，旧的从前面出去
+  QString lineText; // draw 里每一行的文字，反复用
+  RollingHistogram compute, raster, paint, rest, allocsPerFrame;
+  RollingHistogram stages[Profiler::StageNum];
+  size_t figures = 0;
+  long pixels = 0;
+};
@@ -0,0 +1,260 @@
+#pragma once
+// 键鼠事件的录制和回放，curve_core 里只有这个头文件要 Qt，只给 code1 ~ code7 的窗口用：
+//   codeN --record session.bin           照常操作，退出时把窗口收到的输入事件存下来
+//   codeN --replay session.bin [--fast]  按录制时的节奏把事件重新发给窗口，--fast 时一个事件的结果画出来就马上发下一个；
+//                                        放完打印每帧计算、光栅化、贴图用时和事件到画面出来的延迟的 p50 / p99 / max，然后退出
+#include <QtWidgets>
+#include "curve_core/render.h"
+
+class InputSession{
+  // 窗口的 event() 里调 record，新帧贴出来以后调 presented。
+  // 回放时要知道计算线程一共收到过几个任务（submitted）、还有没有攒着没算的输入（waiting：拖拽合并的移动、
+  // 改大小的防抖），--fast 时还要能把攒着的输入马上算掉（flush），这三个由窗口给
+public:
+  using clock = std::chrono::steady_clock;
+  std::function<uint64_t()> submitted;
+  std::function<bool()> waiting;
+  std::function<void()> flush;
+
+  // 解析 --record / --replay，两个都没有就什么都不做；参数不对或者文件读不了返回 false
+  bool start(QWidget* _widget, int argc, char** argv){
+    widget = _widget;
+    for(int i = 1; i < argc; i ++){
+      std::string arg = argv[i];
+      if(arg == "--record" && i + 1 < argc){
+        recordPath = argv[++ i];
+      }
+      else if(arg == "--replay" && i + 1 < argc){
+        replayPath = argv[++ i];
+      }
+      else if(arg == "--fast"){
+        fast = true;
+      }
+    }
+    if(!recordPath.empty() && !replayPath.empty()){
+      std::cerr << "--record and --replay cannot be used together" << endl;
+      return false;
+    }
+    begin = clock::now();
+    if(!recordPath.empty()){
+      // show() 时的改大小事件在这之前就过去了，先把现在的大小记下来
+      InputLog::Event e;
+      e.type = InputLog::Resize;
+      e.a = widget -> width();
+      e.b = widget -> height();
+      recorded.push_back(e);
+    }
+    if(replayPath.empty()){
+      return true;
+    }
+    if(!InputLog::load(replayPath, events)){
+      std::cerr << "cannot read " << replayPath << endl;
+      return false;
+    }
+    QObject::connect(&timer, &QTimer::timeout, [this]{ step(); });
+    timer.setTimerType(Qt::PreciseTimer);
+    timer.start(1);
+    return true;
+  }
+
+  ~InputSession(){
+    if(recordPath.empty()){
+      return;
+    }
+    if(InputLog::save(recorded, recordPath)){
+      cout << "recorded " << recorded.size() << " events to " << recordPath << endl;
+    }
+    else{
+      std::cerr << "cannot write " << recordPath << endl;
+    }
+  }
+
+  void record(QEvent* event){
+    if(recordPath.empty()){
+      return;
+    }
+    InputLog::Event e;
+    e.us = std::chrono::duration_cast<std::chrono::microseconds >(clock::now() - begin).count();
+    switch(event -> type()){
+      case QEvent::MouseButtonPress:
+      case QEvent::MouseButtonDblClick: // 双击的第二下，QWidget 默认也是交给 mousePressEvent
+      case QEvent::MouseButtonRelease:{
+        auto m = static_cast<QMouseEvent* >(event);
+        e.type = event -> type() == QEvent::MouseButtonRelease ? InputLog::Release : InputLog::Press;
+        e.a = int(m -> button());
+        e.b = m -> x();
+        e.c = m -> y();
+        break;
+      }
+      case QEvent::MouseMove:{
+        auto m = static_cast<QMouseEvent* >(event);
+        e.type = InputLog::Move;
+        e.a = int(m -> buttons());
+        e.b = m -> x();
+        e.c = m -> y();
+        break;
+      }
+      case QEvent::KeyPress:{
+        auto k = static_cast<QKeyEvent* >(event);
+        e.type = InputLog::Key;
+        e.a = k -> key();
+        e.b = int(k -> modifiers());
+        break;
+      }
+      case QEvent::Wheel:{
+        auto w = static_cast<QWheelEvent* >(event);
+        e.type = InputLog::Wheel;
+        e.a = w -> angleDelta().y();
+        e.b = int(w -> position().x());
+        e.c = int(w -> position().y());
+        break;
+      }
+      case QEvent::Resize:{
+        auto r = static_cast<QResizeEvent* >(event);
+        e.type = InputLog::Resize;
+        e.a = r -> size().width();
+        e.b = r -> size().height();
+        break;
+      }
+      default:
+        return;
+    }
+    recorded.push_back(e);
+  }
+
+  // 计算线程的一帧贴到了屏幕上；画面没变、不用贴的帧 paintMs 给 0
+  template<class Frame >
+  void presented(const Frame& frame, double paintMs){
+    if(replayPath.empty()){
+      return;
+    }
+    stats.compute.push_back(frame.computeMs);
+    stats.raster.push_back(frame.rasterMs);
+    stats.paint.push_back(paintMs);
+    auto now = clock::now();
+    // 这一帧是按事件发出之后的任务算的，事件的结果就算画出来了
+    vector<Pending > rest;
+    for(auto& p : pending){
+      if(frame.seq > p.seq){
+        stats.latency.push_back(std::chrono::duration<double, std::milli >(now - p.at).count());
+      }
+      else{
+        rest.push_back(p);
+      }
+    }
+    pending.swap(rest);
+  }
+
+private:
+  // 一个发出去了、结果还没画出来的事件；seq 是发之前计算线程收到过的任务数
+  struct Pending{
+    clock::time_point at;
+    uint64_t seq;
+  };
+
+  // 改大小发出去了，窗口还没变到那么大：顶层窗口的大小要等窗口系统答应，改大小事件可能晚一点才到。
+  // 窗口系统不给改（比如比屏幕还大）时最多等 1 秒
+  bool resizing() const {
+    return resizeTo.isValid() && widget -> size() != resizeTo && clock::now() - resizeAt < std::chrono::seconds(1);
+  }
+
+  // 没引出新任务、也没有攒着的输入，这个事件不会有新画面，不算延迟，只记个数
+  void dropIdle(){
+    if(waiting() || resizing()){
+      return;
+    }
+    uint64_t now = submitted();
+    size_t before = pending.size();
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const Pending& p){ return p.seq == now; }), pending.end());
+    idle += before - pending.size();
+  }
+
+  void step(){
+    if(fast && waiting()){
+      flush(); // 不等帧定时器和改大小的防抖，攒着的输入马上算一帧
+    }
+    dropIdle();
+    int64_t us = std::chrono::duration_cast<std::chrono::microseconds >(clock::now() - begin).count();
+    while(next < events.size()){
+      if(fast ? !pending.empty() || waiting() || resizing() : events[next].us - events[0].us > us){
+        break;
+      }
+      dispatch(events[next ++]);
+      if(fast && waiting()){
+        flush(); // 拖拽的每个移动都单独算一帧
+      }
+      dropIdle();
+      lastAt = clock::now();
+    }
+    // 全部发完，等最后的结果画出来，最多等 5 秒
+    if(next == events.size() && (pending.empty() || clock::now() - lastAt > std::chrono::seconds(5))){
+      timer.stop();
+      finish();
+    }
+  }
+
+  void dispatch(const InputLog::Event& e){
+    pending.push_back({clock::now(), submitted()});
+    QPointF pos(e.b, e.c);
+    switch(e.type){
+      case InputLog::Press:{
+        QMouseEvent m(QEvent::MouseButtonPress, pos, Qt::MouseButton(e.a), Qt::MouseButtons(e.a), Qt::NoModifier);
+        QCoreApplication::sendEvent(widget, &m);
+        break;
+      }
+      case InputLog::Release:{
+        QMouseEvent m(QEvent::MouseButtonRelease, pos, Qt::MouseButton(e.a), Qt::NoButton, Qt::NoModifier);
+        QCoreApplication::sendEvent(widget, &m);
+        break;
+      }
+      case InputLog::Move:{
+        QMouseEvent m(QEvent::MouseMove, pos, Qt::NoButton, Qt::MouseButtons(e.a), Qt::NoModifier);
+        QCoreApplication::sendEvent(widget, &m);
+        break;
+      }
+      case InputLog::Key:{
+        QKeyEvent k(QEvent::KeyPress, e.a, Qt::KeyboardModifiers(e.b));
+        QCoreApplication::sendEvent(widget, &k);
+        break;
+      }
+      case InputLog::Wheel:{
+        QWheelEvent w(pos, widget -> mapToGlobal(QPoint(e.b, e.c)), QPoint(), QPoint(0, e.a),
+          Qt::NoButton, Qt::NoModifier, Qt::NoScrollPhase, false);
+        QCoreApplication::sendEvent(widget, &w);
+        break;
+      }
+      case InputLog::Resize:
+        resizeTo = QSize(e.a, e.b);
+        resizeAt = clock::now();
+        widget -> resize(resizeTo);
+        break;
+    }
+  }
+
+  void finish(){
+    double seconds = std::chrono::duration<double >(clock::now() - begin).count();
+    cout << "replay " << replayPath << (fast ? " (fast)" : "") << ": " << events.size() << " events in " << seconds << " s";
+    if(idle > 0){
+      cout << ", " << idle << " without a new frame";
+    }
+    if(!pending.empty()){
+      cout << ", " << pending.size() << " never presented";
+    }
+    cout << endl;
+    stats.print(cout);
+    QCoreApplication::quit();
+  }
+
+  QWidget* widget = nullptr;
+  std::string recordPath, replayPath;
+  bool fast = false;
+  clock::time_point begin, lastAt;
+  vector<InputLog::Event > recorded, events;
+  size_t next = 0;
+  vector<Pending > pending;
+  size_t idle = 0; // 发出去以后没有新画面的事件个数，比如按 H、点了没变化的地方
+  QSize resizeTo; // 最近一次回放的改大小，还没发过是无效的 QSize
+  clock::time_point resizeAt;
+  LatencyStats stats;
+  QTimer timer;
+};
@@ -0,0 +1,2856 @@
+#pragma once
+// 画图的部分：Figure 和光栅化、画布、分层缓存、计算线程、无界面模式，不依赖 Qt，
+// 窗口程序只拿 Canvas 里的像素交给 QPainter
+#include "base.h"
+#include "trace.h"
+
+inline uint32_t packColor(const Vector4i& color){
+  // 打包成不透明的 ARGB32，和 QImage::Format_ARGB32_Premultiplied 的像素一致
+  return 0xff000000u | (uint32_t(color.x() & 255) << 16) | (uint32_t(color.y() & 255) << 8) | uint32_t(color.z() & 255);
+}
+
+struct Profiler{
+  // 流水线各阶段的耗时，给性能面板用：ScopedTimer 把耗时按阶段累加到这里，
+  // 计算线程每算完一帧 take() 一次，跟着帧交给 GUI。enabled 为 false（默认）时计时器什么都不做
+  enum Stage{ Solve, Sample, Simplify, Prepare, Composite, StageNum };
+  static constexpr const char* names[StageNum] = {"solve", "sample", "simplify", "paint list", "composite"};
+  inline static std::atomic<bool > enabled{false};
+  inline static std::atomic<int64_t > ns[StageNum];
+  inline static std::atomic<long > allocs{0}; // enabled 时流水线线程里全局 operator new 的次数，编进了 alloc_count.cpp 才会涨
+  // 这个线程的分配算不算进 allocs：计算线程、光栅化的工作线程和无界面模式的主线程打开，
+  // GUI 线程贴图、画性能面板和 Qt 自己的线程里的分配都不算
+  inline static thread_local bool pipelineThread = false;
+
+  static void add(Stage stage, std::chrono::steady_clock::duration d){
+    ns[stage].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds >(d).count(), std::memory_order_relaxed);
+  }
+
+  // 取走各阶段累计的毫秒数并清零
+  static std::array<double, StageNum > take(){
+    std::array<double, StageNum > ms;
+    for(int i = 0; i < StageNum; i ++){
+      ms[i] = ns[i].exchange(0, std::memory_order_relaxed) / 1e6;
+    }
+    return ms;
+  }
+};
+
+class ScopedTimer{
+  // 给一个阶段计时，从构造到析构。嵌套时只算自己的：里层开始时外层先停表，里层结束后外层接着计。
+  // 开着 --trace 时同时在 trace 里记一段同名的区间（包括里层）
+  using clock = std::chrono::steady_clock;
+  inline static thread_local ScopedTimer* top = nullptr;
+  Profiler::Stage stage;
+  bool on;
+  ScopedTimer* parent = nullptr;
+  clock::time_point begin;
+  TraceSpan span;
+
+public:
+  explicit ScopedTimer(Profiler::Stage _stage) : stage{_stage}, on{Profiler::enabled.load(std::memory_order_relaxed)}, span{Profiler::names[_stage]} {
+    if(!on){
+      return;
+    }
+    begin = clock::now();
+    parent = top;
+    if(parent){
+      Profiler::add(parent -> stage, begin - parent -> begin);
+    }
+    top = this;
+  }
+
+  ~ScopedTimer(){
+    if(!on){
+      return;
+    }
+    auto end = clock::now();
+    Profiler::add(stage, end - begin);
+    if(parent){
+      parent -> begin = end;
+    }
+    top = parent;
+  }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+struct PaintList{
+  // 一个 Figure 的全部像素，颜色整个 Figure 只存一份
+  // x、y 各自连续存放，push 的时候就夹到 [0, ww - 1] x [0, hh - 1] 里
+  // a 是每个像素的覆盖率（0 ~ 255），只有抗锯齿（pixelSize 为 1）时才有，空表示每个像素都盖满
+  uint32_t color = 0;
+  veci x, y;
+  vector<uint8_t > a;
+  int ww = 0, hh = 0;
+
+  // 清空但保留容量，同一个 PaintList 可以反复使用
+  void reset(int _ww, int _hh, uint32_t _color){
+    x.clear();
+    y.clear();
+    a.clear();
+    ww = _ww;
+    hh = _hh;
+    color = _color;
+  }
+
+  void push(int _x, int _y){
+    x.push_back(max(0, min(ww - 1, _x)));
+    y.push_back(max(0, min(hh - 1, _y)));
+  }
+
+  void push(int _x, int _y, uint8_t cover){
+    push(_x, _y);
+    a.push_back(cover);
+  }
+
+  // 从第 from 个起只留下碰到 [rowBegin, rowEnd) 这些行的方块，抗锯齿的像素就是 1 x 1 的方块
+  void keepRows(size_t from, int pixelSize, int rowBegin, int rowEnd){
+    bool smooth = !a.empty();
+    size_t m = from;
+    for(size_t k = from; k < x.size(); k ++){
+      if(y[k] < rowEnd && y[k] + pixelSize > rowBegin){
+        x[m] = x[k];
+        y[m] = y[k];
+        if(smooth){
+          a[m] = a[k];
+        }
+        m ++;
+      }
+    }
+    x.resize(m);
+    y.resize(m);
+    if(smooth){
+      a.resize(m);
+    }
+  }
+
+  size_t size() const { return x.size(); }
+};
+
+struct Sprite{
+  // 预先算好的图案，坐标都相对图案中心
+  // blocks 是每个 pixelSize 方块的左上角，生成 PaintList 用
+  // spans 是按行合并好的像素区间，直接整行贴进 Canvas 用
+  // soft 是抗锯齿时边缘上只盖住一部分的像素，按覆盖率混合
+  struct Span{ int dy, dx0, dx1; }; // 第 dy 行的 [dx0, dx1)
+  struct Soft{ int dx, dy; uint8_t a; };
+  vector<pair<int, int > > blocks;
+  vector<Span > spans;
+  vector<Soft > soft;
+  int top = 0, bottom = 0; // 覆盖的行 [top, bottom)
+  int left = 0, right = 0; // 覆盖的列 [left, right)
+};
+
+struct Stamp{
+  // 把 sprite 贴在 (x, y)，sprite 为空表示这个 Figure 没有现成的图案
+  const Sprite* sprite = nullptr;
+  int x = 0, y = 0;
+};
+
+class Figure{ 
+  
+  virtual void makePaintList(PaintList& list, int pixelSize) const = 0;
+  static inline std::atomic<long > live{0}; // 当前存活的 Figure 个数，计算线程和主线程都会创建 Figure
+protected:
+  uint32_t color = 0;
+public:
+  Figure(const Vector4i& _color) : color{packColor(_color)} { live ++; }
+  Figure(const Figure& other) : color{other.color} { live ++; }
+  virtual ~Figure(){ live --; };  // 虚析构函数
+
+  static long liveCount(){
+    return live;
+  }
+
+  PaintList getPaintList(int ww, int hh, int pixelSize) const {
+    PaintList list;
+    getPaintList(list, ww, hh, pixelSize);
+    return list;
+  }
+
+  void getPaintList(PaintList& list, int ww, int hh, int pixelSize) const {
+    TraceSpan span("getPaintList");
+    list.reset(ww, hh, color);
+    makePaintList(list, pixelSize);
+    assert(list.x.size() == list.y.size());
+    assert(list.a.empty() || list.a.size() == list.x.size());
+  }
+
+  // 只要碰到 [rowBegin, rowEnd) 这些行的像素（方块），Canvas::prepare 按行分块并行生成用
+  void getPaintList(PaintList& list, int ww, int hh, int pixelSize, int rowBegin, int rowEnd) const {
+    TraceSpan span("getPaintList");
+    list.reset(ww, hh, color);
+    makeRows(list, pixelSize, rowBegin, rowEnd);
+    assert(list.x.size() == list.y.size());
+    assert(list.a.empty() || list.a.size() == list.x.size());
+  }
+
+  // 默认整个生成再挑出这几行，又长又多的 Figure 重载它，只算碰到这几行的部分
+  virtual void makeRows(PaintList& list, int pixelSize, int rowBegin, int rowEnd) const {
+    makePaintList(list, pixelSize);
+    list.keepRows(0, pixelSize, rowBegin, rowEnd);
+  }
+
+  // 有固定图案的 Figure 重载它，Canvas 直接按行贴图，不用逐像素生成
+  virtual Stamp getStamp([[maybe_unused]] int pixelSize) const {
+    return {};
+  }
+
+  uint32_t getColor() const { return color; }
+};
+
+// 批量画线的内层循环靠自动向量化，要 AVX-512 才明显比逐像素做除法快（只有 AVX2 时差不多）。
+// 默认编译只能用 SSE2，所以在支持的编译器上按 AVX-512、AVX2 和通用指令各编一份，运行时按 CPU 选；
+// 打开 CURVE_NATIVE 并且本机有 AVX-512 时用不着
+#if defined(__x86_64__) && defined(__linux__) && !defined(__AVX512F__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define CURVE_VECTOR_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+#ifndef CURVE_VECTOR_CLONES
+#define CURVE_VECTOR_CLONES
+#endif
+
+class Line : public Figure{
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+
+  // 攒在批里的一段：第 k 个方块主方向坐标 m0 + k * pixelSize，副方向 floor((num + k * step) / len)
+  struct Segment{
+    int m0, count;
+    double num, step, len, inv;
+    bool xMajor;
+  };
+
+  // 把一批段的方块依次写进 xs、ys，坐标夹到画布里。
+  // 副方向坐标用 double 乘倒数估出商，再用一次比较修正成精确的 floor，整段不做除法，
+  // 内层循环没有分支也没有跨迭代的依赖，编译器可以直接向量化
+  CURVE_VECTOR_CLONES
+  static void writeSegments(const Segment* segments, int pending, int* xs, int* ys, int ww, int hh, int pixelSize){
+    for(int s = 0; s < pending; s ++){
+      const Segment& seg = segments[s];
+      int* major = seg.xMajor ? xs : ys;
+      int* minor = seg.xMajor ? ys : xs;
+      int majorMax = (seg.xMajor ? ww : hh) - 1;
+      int minorMax = (seg.xMajor ? hh : ww) - 1;
+      double num = seg.num, step = seg.step, len = seg.len, inv = seg.inv;
+      int m0 = seg.m0, count = seg.count; // 拷成局部变量，否则编译器怕写 major/minor 时改到 seg，不敢向量化
+      for(int k = 0; k < count; k ++){
+        double v = num + k * step;
+        double q = int(v * inv); // 商在 ±2^30 以内，截断后再修正成 floor
+        q -= q * len > v;
+        q += (q + 1) * len <= v;
+        q = q < minorMax ? (q > 0 ? q : 0) : minorMax;
+        int mv = m0 + k * pixelSize;
+        major[k] = mv < majorMax ? (mv > 0 ? mv : 0) : majorMax;
+        minor[k] = int(q);
+      }
+      xs += count;
+      ys += count;
+    }
+  }
+
+  static long long floorDiv(long long a, long long b){
+    // 两个数都在 int 范围内就用 32 位除法，64 位除法在不少 CPU 上要慢好几倍
+    if(a == int(a) && b == int(b)){
+      int q = int(a) / int(b);
+      return q - ((int(a) % int(b) != 0) && ((a < 0) != (b < 0)));
+    }
+    long long q = a / b;
+    return q - ((a % b != 0) && ((a < 0) != (b < 0)));
+  }
+
+  // f 在 [0, count) 上单调（增减都行），返回 lo <= f(k) < hi 的那一段 [kb, ke)，二分找两头
+  template<class F >
+  static pair<int, int > monotoneRange(int count, F&& f, long long lo, long long hi){
+    if(count <= 0){
+      return {0, 0};
+    }
+    bool up = f(0) <= f(count - 1);
+    auto first = [&](auto pred){ // pred(f(k)) 随 k 先假后真，返回第一个真的 k
+      int a = 0, b = count;
+      while(a < b){
+        int mid = a + (b - a) / 2;
+        if(pred(f(mid))){
+          b = mid;
+        }
+        else{
+          a = mid + 1;
+        }
+      }
+      return a;
+    };
+    if(up){
+      return {first([&](long long v){ return v >= lo; }), first([&](long long v){ return v >= hi; })};
+    }
+    return {first([&](long long v){ return v < hi; }), first([&](long long v){ return v < lo; })};
+  }
+
+  static long long ceilDiv(long long a, long long b){
+    return -floorDiv(-a, b);
+  }
+
+  // 第 k 个方块的行是 floor((num + k * step) / len) 夹到 [0, rowMax]，len > 0；
+  // 返回行在 [lo, hi) 里的那一段 [kb, ke)，直接解一次不等式，和 monotoneRange 结果一样但不用二分
+  static pair<int, int > rowRange(long long num, long long step, long long len, int count, long long lo, long long hi, int rowMax){
+    // 夹过以后 >= lo：lo <= 0 时总成立，lo > rowMax 时总不成立，其他时候和不夹一样；< hi 同理
+    if(count <= 0 || lo >= hi || lo > rowMax || hi <= 0){
+      return {0, 0};
+    }
+    long long kb = 0, ke = count;
+    if(lo > 0){ // num + k * step >= lo * len
+      long long t = lo * len;
+      if(step > 0){
+        kb = max(kb, ceilDiv(t - num, step));
+      }
+      else if(step < 0){
+        ke = min(ke, floorDiv(num - t, -step) + 1);
+      }
+      else if(num < t){
+        ke = 0;
+      }
+    }
+    if(hi <= rowMax){ // num + k * step < hi * len
+      long long t = hi * len;
+      if(step > 0){
+        ke = min(ke, ceilDiv(t - num, step));
+      }
+      else if(step < 0){
+        kb = max(kb, floorDiv(num - t, -step) + 1);
+      }
+      else if(num >= t){
+        ke = 0;
+      }
+    }
+    kb = min(kb, (long long)count);
+    return {int(kb), int(max(kb, ke))};
+  }
+
+  // 沿主方向每次走 pixelSize，副方向坐标 = floor(num / len)，num 每步加 step
+  // 商和余数一起增量维护，整段只在开头做两次除法
+  template<bool xMajor >
+  static void walk(int m0, int m1, long long num, long long step, long long len, int pixelSize, PaintList& list){
+    long long q = floorDiv(num, len), r = num - q * len;
+    long long dq = floorDiv(step, len), dr = step - dq * len;
+    long long m = m0;
+    for(size_t k = floorDiv((long long)m1 - m0, pixelSize) + 1; k > 0; k --, m += pixelSize){
+      if(xMajor){
+        list.push(m, q);
+      }
+      else{
+        list.push(q, m);
+      }
+      // 进位写成不带分支的形式，r 什么时候越过 len 基本没规律，写成 if 会频繁猜错
+      r += dr;
+      long long carry = r >= len;
+      r -= carry * len;
+      q += dq + carry;
+    }
+  }
+
+public:
+  Line(int _x0, int _y0, int _x1, int _y1, Vector4i _color)
+    : Figure{_color}, x0{_x0}, x1{_x1}, y0{_y0}, y1{_y1} {}
+
+  void makePaintList(PaintList& list, int pixelSize) const override {  
+    float x[2] = {float(x0), float(x1)}, y[2] = {float(y0), float(y1)};
+    if(pixelSize == 1){
+      appendSmooth(x, y, 2, false, list);
+    }
+    else{
+      appendSegments(x, y, 2, false, pixelSize, list);
+    }
+  }
+
+  // Liang-Barsky：把线段裁到 [0, ww - 1] x [0, hh - 1] 里，整段都在外面（或者坐标不是有限数）返回 false
+  // 在浮点里裁完再转整数，屏幕外的部分一个像素都不生成，也不会挤在边界上
+  static bool clip(double& x0, double& y0, double& x1, double& y1, double ww, double hh){
+    // 两端都在画布里（大多数段）不用裁，省下四次除法；有 NaN 时比较为假，走下面
+    if(x0 >= 0 && x0 <= ww - 1 && x1 >= 0 && x1 <= ww - 1 && y0 >= 0 && y0 <= hh - 1 && y1 >= 0 && y1 <= hh - 1){
+      return true;
+    }
+    if(!(std::isfinite(x0) && std::isfinite(y0) && std::isfinite(x1) && std::isfinite(y1))){
+      return false;
+    }
+    double dx = x1 - x0, dy = y1 - y0;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {x0, ww - 1 - x0, y0, hh - 1 - y0};
+    double t0 = 0, t1 = 1;
+    for(int k = 0; k < 4; k ++){
+      if(p[k] == 0){
+        if(q[k] < 0){
+          return false;
+        }
+        continue;
+      }
+      double r = q[k] / p[k];
+      if(p[k] < 0){
+        t0 = max(t0, r);
+      }
+      else{
+        t1 = min(t1, r);
+      }
+      if(t0 > t1){
+        return false;
+      }
+    }
+    double ax = x0, ay = y0;
+    x0 = ax + t0 * dx;
+    y0 = ay + t0 * dy;
+    x1 = ax + t1 * dx;
+    y1 = ay + t1 * dy;
+    return true;
+  }
+
+  // 浮点坐标转成像素坐标，太远的截到 ±2^30，后面的整数运算不会溢出
+  static int toPixel(double v){
+    const double limit = 1 << 30;
+    return v >= limit ? (1 << 30) : v <= -limit ? -(1 << 30) : int(v);
+  }
+
+  // 把线段 (x0, y0) - (x1, y1) 的像素追加到 list 后面
+  // 副方向坐标是 (y0 * (x1 - x) + y1 * (x - x0 + 1)) / (x1 - x0 + 1) 向下取整
+  static void appendSegment(int x0, int y0, int x1, int y1, int pixelSize, PaintList& list){
+    using std::swap;
+    if(std::abs((long long)x0 - x1) >= std::abs((long long)y0 - y1)){
+      if(x0 > x1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      walk<true >(x0, x1, (long long)y0 * (x1 - x0) + y1, (long long)pixelSize * (y1 - y0), (long long)x1 - x0 + 1, pixelSize, list);
+    }
+    else{
+      if(y0 > y1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      walk<false >(y0, y1, (long long)x0 * (y1 - y0) + x1, (long long)pixelSize * (x1 - x0), (long long)y1 - y0 + 1, pixelSize, list);
+    }
+  }
+
+  // 两头都在画布里的短段，和 appendSegment 一样的像素，每个方块直接做一次 32 位除法
+  static void appendShort(int x0, int y0, int x1, int y1, int pixelSize, PaintList& list){
+    using std::swap;
+    if(std::abs(x0 - x1) >= std::abs(y0 - y1)){
+      if(x0 > x1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      int len = x1 - x0 + 1;
+      for(int x = x0; x <= x1; x += pixelSize){
+        list.x.push_back(x);
+        list.y.push_back((y0 * (x1 - x) + y1 * (x - x0 + 1)) / len);
+      }
+    }
+    else{
+      if(y0 > y1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      int len = y1 - y0 + 1;
+      for(int y = y0; y <= y1; y += pixelSize){
+        list.x.push_back((x0 * (y1 - y) + x1 * (y - y0 + 1)) / len);
+        list.y.push_back(y);
+      }
+    }
+  }
+
+  // 批量版本，一次光栅化整条折线的 m 段（closed 时最后一段连回起点）
+  static void appendSegments(const float* x, const float* y, int n, bool closed, int pixelSize, PaintList& list){
+    appendSegments(x, y, n, 0, closed ? n : n - 1, pixelSize, 0, list.hh, list);
+  }
+
+  // 第 [s0, s1) 段（编号和 plotSmooth 一样），只要碰到 [rowBegin, rowEnd) 这些行的方块
+  // 每攒一批段先算出参数和像素数，list 一次扩到位，再交给 writeSegments 直接往数组里写坐标；
+  // 一批只攒 256 段，段参数始终在 L1 里。
+  // 批里每段还要裁剪、判断在不在这几行里，只有几个方块的短段这些开销比写像素还贵，所以短段不进批，见下面和 LineBench
+  static void appendSegments(const float* x, const float* y, int n, int s0, int s1, int pixelSize, int rowBegin, int rowEnd, PaintList& list){
+    const int batch = 256;
+    Segment segments[batch];
+    int pending = 0;
+    size_t total = 0;
+
+    auto flush = [&](){
+      if(pending == 0){
+        return;
+      }
+      size_t pos = list.x.size();
+      list.x.resize(pos + total);
+      list.y.resize(pos + total);
+      writeSegments(segments, pending, list.x.data() + pos, list.y.data() + pos, list.ww, list.hh, pixelSize);
+      pending = 0;
+      total = 0;
+    };
+
+    const double exact = double(1ll << 52); // 超过这个范围 double 算不准，退回整数版本
+    const double invSize = 1.0 / pixelSize;
+    // 短段：两头都在画布里、不到 shortBlocks 个方块、整段都在这几行里，不裁剪也不进批，直接逐个方块做除法。
+    // 采样出来的曲线大多是这种几个像素的段，批里那些准备工作比写像素本身还贵；
+    // 坐标都不是负的，截断就是 floor，画布不太大时 32 位整数放得下
+    const int shortBlocks = 16;
+    const float right = list.ww - 1, bottom = list.hh - 1;
+    const bool shortFits = (long long)max(list.ww, list.hh) * (shortBlocks * (long long)pixelSize + 1) < (1ll << 30);
+    for(int i = s0; i < s1; i ++){
+      int j = i + 1 == n ? 0 : i + 1;
+      if(shortFits && x[i] >= 0 && x[i] <= right && x[j] >= 0 && x[j] <= right && y[i] >= 0 && y[i] <= bottom && y[j] >= 0 && y[j] <= bottom){
+        int ax = x[i], ay = y[i], bx = x[j], by = y[j];
+        if(max(std::abs(ax - bx), std::abs(ay - by)) < shortBlocks * pixelSize && min(ay, by) + pixelSize > rowBegin && max(ay, by) < rowEnd){
+          flush(); // 先把攒着的段写完，保持像素顺序
+          appendShort(ax, ay, bx, by, pixelSize, list);
+          continue;
+        }
+      }
+      if(max(y[i], y[j]) + pixelSize + 1 < rowBegin || min(y[i], y[j]) - 1 >= rowEnd){
+        continue; // 先用端点粗筛，碰不到这几行的段不用裁剪；有 NaN 时比较为假，留给 clip 扔掉
+      }
+      double fx0 = x[i], fy0 = y[i], fx1 = x[j], fy1 = y[j];
+      if(!clip(fx0, fy0, fx1, fy1, list.ww, list.hh)){
+        continue;
+      }
+      int ax = toPixel(fx0), ay = toPixel(fy0), bx = toPixel(fx1), by = toPixel(fy1);
+      bool xMajor = std::abs((long long)ax - bx) >= std::abs((long long)ay - by);
+      if(!xMajor){
+        std::swap(ax, ay);
+        std::swap(bx, by);
+      }
+      if(ax > bx){
+        std::swap(ax, bx);
+        std::swap(ay, by);
+      }
+      long long len = (long long)bx - ax + 1;
+      long long num = (long long)ay * (bx - ax) + by;
+      long long step = (long long)pixelSize * (by - ay);
+      // 方块数 floor((len - 1) / pixelSize) + 1，和 flush 一样乘倒数再修正，每段省一次整数除法
+      long long count = (long long)((len - 1) * invSize);
+      count -= count * pixelSize > len - 1;
+      count += (count + 1) * pixelSize <= len - 1;
+      count ++;
+      if(std::abs((double)num) + std::abs((double)step) * count >= exact){
+        flush(); // 先把攒着的段写完，保持像素顺序
+        size_t pos = list.size();
+        if(xMajor){
+          appendSegment(ax, ay, bx, by, pixelSize, list);
+        }
+        else{
+          appendSegment(ay, ax, by, bx, pixelSize, list);
+        }
+        list.keepRows(pos, pixelSize, rowBegin, rowEnd);
+        continue;
+      }
+      // 方块的行坐标随 k 单调，范围是 [lo, hi]；整段都碰到这几行（大多数情况）就不用找
+      int lo = xMajor ? min(ay, by) : ax, hi = xMajor ? max(ay, by) : bx;
+      if(hi + pixelSize <= rowBegin || lo >= rowEnd){
+        continue;
+      }
+      int kb = 0, ke = int(count);
+      double inv = 1.0 / len;
+      if(lo + pixelSize <= rowBegin || hi >= rowEnd){
+        // flush 里算出的就是精确的 floor，这里用整数解出同一段，不会差一个像素
+        if(xMajor){
+          std::tie(kb, ke) = rowRange(num, step, len, int(count), rowBegin - pixelSize + 1, rowEnd, list.hh - 1);
+        }
+        else{
+          std::tie(kb, ke) = rowRange(ax, pixelSize, 1, int(count), rowBegin - pixelSize + 1, rowEnd, list.hh - 1);
+        }
+        if(kb >= ke){
+          continue;
+        }
+      }
+      segments[pending ++] = {ax + kb * pixelSize, ke - kb, double(num + kb * step), double(step), double(len), inv, xMajor};
+      total += ke - kb;
+      if(pending == batch){
+        flush();
+      }
+    }
+    flush();
+  }
+
+  // 抗锯齿用的覆盖率缓冲，每个线程一份，大小跟着画布
+  // 一个 Figure 的所有线段先把覆盖率按像素取最大值攒在这里，折线拐点上相邻两段重叠的像素不会叠两遍变深；
+  // 像素第一次被碰到时记下坐标，最后连同覆盖率一起输出，同时把用过的地方清零，下一次不用整块清
+  struct Coverage{
+    vector<uint8_t > cover;
+    veci xs, ys, touched; // 碰到过的像素的坐标和在 cover 里的下标，前 n 个有效，只增不减
+    int n = 0;
+    int ww = 0, hh = 0;
+    int rowBegin = 0, rowEnd = 0; // 只收 [rowBegin, rowEnd) 这些行里的像素
+
+    static Coverage& local(){
+      thread_local Coverage coverage;
+      return coverage;
+    }
+
+    // 开始一个 Figure，画布 ww x hh，只要 [_rowBegin, _rowEnd) 这些行
+    void begin(int _ww, int _hh, int _rowBegin, int _rowEnd){
+      if(ww != _ww || hh != _hh){
+        ww = _ww;
+        hh = _hh;
+        cover.assign(size_t(max(ww, 0)) * max(hh, 0), 0);
+      }
+      rowBegin = max(_rowBegin, 0);
+      rowEnd = min(_rowEnd, hh);
+    }
+
+    // 保证后面还能再 plot extra 次
+    void reserve(int extra){
+      if(size_t(n + extra) > touched.size()){
+        size_t size = max(size_t(n + extra), touched.size() * 2);
+        xs.resize(size);
+        ys.resize(size);
+        touched.resize(size);
+      }
+    }
+
+    // 不管是不是第一次碰到都先写到第 n 个位置，是第一次才让 n 加一，不用分支
+    void plot(int x, int y, int a){
+      if(unsigned(x) >= unsigned(ww) || y < rowBegin || y >= rowEnd){
+        return;
+      }
+      int p = y * ww + x;
+      int c = cover[p];
+      xs[n] = x;
+      ys[n] = y;
+      touched[n] = p;
+      n += (c == 0) & (a > 0);
+      cover[p] = max(c, a);
+    }
+
+    void flush(PaintList& list){
+      list.x.insert(list.x.end(), xs.begin(), xs.begin() + n);
+      list.y.insert(list.y.end(), ys.begin(), ys.begin() + n);
+      size_t base = list.a.size();
+      list.a.resize(base + n);
+      for(int k = 0; k < n; k ++){
+        list.a[base + k] = cover[touched[k]];
+        cover[touched[k]] = 0;
+      }
+      n = 0;
+    }
+  };
+
+  // 全分辨率抗锯齿（Wu 算法）：沿主方向在每个像素中心求出线的副方向坐标，
+  // 按它到两边像素中心的距离把覆盖率分给这两个像素，两个加起来正好盖满一个像素
+  static void appendSmooth(const float* x, const float* y, int n, bool closed, PaintList& list){
+    Coverage& coverage = Coverage::local();
+    coverage.begin(list.ww, list.hh, 0, list.hh);
+    plotSmooth(x, y, n, 0, closed ? n : n - 1, coverage);
+    coverage.flush(list);
+  }
+
+  // 第 [s0, s1) 段（第 i 段连着第 i 个点和下一个点，最后一个点的下一个是第 0 个）画进 coverage，
+  // 只算落在 coverage 那几行里的像素。一段先成批算出副方向坐标和覆盖率
+  // （没有分支也没有跨迭代的依赖，编译器可以向量化），再写进覆盖率缓冲；
+  // 每一批从哪开始只和线段有关，所以只画几行时算出来的覆盖率和整条画时完全一样
+  static void plotSmooth(const float* x, const float* y, int n, int s0, int s1, Coverage& coverage){
+    const int batch = 256;
+    int minor[batch], cover[batch];
+    for(int i = s0; i < s1; i ++){
+      int j = i + 1 == n ? 0 : i + 1;
+      if(max(y[i], y[j]) + 2 < coverage.rowBegin || min(y[i], y[j]) - 2 >= coverage.rowEnd){
+        continue; // 先用端点粗筛，同 appendSegments
+      }
+      double x0 = x[i], y0 = y[i], x1 = x[j], y1 = y[j];
+      if(!clip(x0, y0, x1, y1, coverage.ww, coverage.hh)){
+        continue;
+      }
+      bool xMajor = std::abs(x1 - x0) >= std::abs(y1 - y0);
+      if(!xMajor){
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+      }
+      if(x0 > x1){
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+      }
+      if(!(x1 > x0)){
+        continue; // 退化成一个点，前后的线段会盖住它
+      }
+      double g = (y1 - y0) / (x1 - x0);
+      // 主方向上像素中心落在 [x0, x1] 里的像素，坐标减 0.5 以后像素中心就是整数
+      int m0 = int(std::ceil(x0 - 0.5)), m1 = int(std::floor(x1 - 0.5));
+      int rowBegin = coverage.rowBegin, rowEnd = coverage.rowEnd;
+      bool search = false; // 有一部分在这几行外面，要逐批找出画到这几行的那一段
+      if(xMajor){
+        // 副方向就是行，两头各留一行余量，舍入误差也不会超出
+        double lo = std::floor(min(y0, y1) - 0.5) - 1, hi = std::floor(max(y0, y1) - 0.5) + 2;
+        if(hi < rowBegin || lo >= rowEnd){
+          continue;
+        }
+        search = lo < rowBegin || hi >= rowEnd;
+      }
+      else{
+        // 主方向就是行，碰不到的批整个跳过
+        m0 += max(0, (rowBegin - m0) / batch * batch);
+        m1 = min(m1, rowEnd - 1);
+      }
+      for(int k0 = m0; k0 <= m1; k0 += batch){
+        int count = min(batch, m1 - k0 + 1);
+        double c0 = y0 - 0.5 + g * (k0 + 0.5 - x0);
+        // 这一批里画到这几行的是哪一段：列方向为主时副方向坐标随 k 单调，画的是 minor 和 minor + 1 两行
+        int kb = 0, ke = count;
+        if(search){
+          std::tie(kb, ke) = monotoneRange(count, [&](int k){ return (long long)std::floor(c0 + g * k); }, rowBegin - 1, rowEnd);
+        }
+        else if(!xMajor){
+          kb = min(count, max(0, rowBegin - k0));
+        }
+        coverage.reserve(2 * (ke - kb));
+        for(int k = kb; k < ke; k ++){
+          double c = c0 + g * k;
+          double f = std::floor(c);
+          minor[k] = int(f);
+          cover[k] = int((c - f) * 255 + 0.5);
+        }
+        for(int k = kb; k < ke; k ++){
+          if(xMajor){
+            coverage.plot(k0 + k, minor[k], 255 - cover[k]);
+            coverage.plot(k0 + k, minor[k] + 1, cover[k]);
+          }
+          else{
+            coverage.plot(minor[k], k0 + k, 255 - cover[k]);
+            coverage.plot(minor[k] + 1, k0 + k, cover[k]);
+          }
+        }
+      }
+    }
+  }
+
+  ~Line() override {};
+};
+
+class Polyline : public Figure{
+  // 一整条折线，采样点连续存放，一条曲线只需要一个 Figure
+  // 采样点按标准库的 allocator_arg 约定从传进来的 allocator 分配，Scene::add 里传的是帧 arena，
+  // 从 CurveMemo 拷过来的采样点也就不碰全局堆
+  static constexpr int chunk = 16; // 每这么多段记一个纵坐标范围，只画几行时碰不到的整组跳过
+  std::pmr::vector<float > x, y;
+  std::pmr::vector<pair<float, float > > rows; // 每组段的纵坐标范围，有不是有限数的坐标时是整条数轴
+  bool closed = false; // 首尾相连
+
+  int segmentNum() const {
+    int n = x.size();
+    return closed ? n : max(n - 1, 0);
+  }
+
+public:
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte >;
+
+  Polyline(std::allocator_arg_t, const allocator_type& alloc, const vecf& _x, const vecf& _y, Vector4i _color, bool _closed = false)
+    : Figure{_color}, x(_x.begin(), _x.end(), alloc), y(_y.begin(), _y.end(), alloc), rows(alloc), closed{_closed} {
+    assert(x.size() == y.size());
+    int n = y.size(), m = segmentNum();
+    const float inf = std::numeric_limits<float >::infinity();
+    rows.resize((m + chunk - 1) / chunk, {inf, -inf});
+    for(int i = 0; i < m; i ++){
+      auto& [lo, hi] = rows[i / chunk];
+      for(float v : {y[i], y[i + 1 == n ? 0 : i + 1]}){
+        if(std::isfinite(v)){
+          lo = min(lo, v);
+          hi = max(hi, v);
+        }
+        else{
+          lo = -inf;
+          hi = inf;
+        }
+      }
+    }
+  }
+
+  Polyline(const vecf& _x, const vecf& _y, Vector4i _color, bool _closed = false)
+    : Polyline(std::allocator_arg, allocator_type(), _x, _y, _color, _closed) {}
+
+  void makePaintList(PaintList& list, int pixelSize) const override {  
+    if(pixelSize == 1){
+      Line::appendSmooth(x.data(), y.data(), x.size(), closed, list);
+    }
+    else{
+      Line::appendSegments(x.data(), y.data(), x.size(), closed, pixelSize, list);
+    }
+  }
+
+  // 连着几组碰得到这几行的段一起交给 Line，组的纵坐标范围往外放宽一个方块再加一行，取整也不会漏
+  void makeRows(PaintList& list, int pixelSize, int rowBegin, int rowEnd) const override {
+    int m = segmentNum();
+    Line::Coverage* coverage = nullptr;
+    if(pixelSize == 1){
+      coverage = &Line::Coverage::local();
+      coverage -> begin(list.ww, list.hh, rowBegin, rowEnd);
+    }
+    for(int c = 0; c < int(rows.size()); ){
+      auto near = [&](int c){ return rows[c].second + pixelSize + 1 >= rowBegin && rows[c].first - pixelSize - 1 < rowEnd; };
+      if(!near(c)){
+        c ++;
+        continue;
+      }
+      int end = c + 1;
+      while(end < int(rows.size()) && near(end)){
+        end ++;
+      }
+      int s0 = c * chunk, s1 = min(m, end * chunk);
+      if(coverage){
+        Line::plotSmooth(x.data(), y.data(), x.size(), s0, s1, *coverage);
+      }
+      else{
+        Line::appendSegments(x.data(), y.data(), x.size(), s0, s1, pixelSize, rowBegin, rowEnd, list);
+      }
+      c = end;
+    }
+    if(coverage){
+      coverage -> flush(list);
+    }
+  }
+
+  ~Polyline() override {};
+};
+
+struct AdaptiveSampler{
+  // 自适应采样：参数区间中点离弦的距离超过 tol 就对半分，
+  // 直的地方一段弦就够，弯的地方一直分到看不出折角为止
+  // f(t) 返回曲线上 t 处的点，任何能求值的曲线都能用
+  double tol = 0.5;   // 允许的弦高，单位和坐标一样（屏幕像素）
+  int minSeg = 16;    // 先均匀切成这么多段，防止中点恰好落在弦上把一整段 S 形当成直线
+  int maxDepth = 20;  // 每段最多再分这么多层，放大很多倍时看得到的那一小段也要分得够细
+  double ww = 0, hh = 0; // 画布大小，整段都在画布同一侧外面时不再细分；为 0 不裁
+
+  template<class F >
+  void sample(F&& f, double t0, double t1, vecf& xs, vecf& ys) const {
+    ScopedTimer timer(Profiler::Sample);
+    Vector2d a = f(t0);
+    xs.push_back(a.x());
+    ys.push_back(a.y());
+    double dt = (t1 - t0) / minSeg;
+    for(int i = 0; i < minSeg; i ++){
+      double s0 = t0 + dt * i, s1 = i + 1 == minSeg ? t1 : s0 + dt;
+      Vector2d b = f(s1), m = f((s0 + s1) / 2);
+      divide(f, s0, a, m, s1, b, maxDepth, xs, ys);
+      a = b;
+    }
+  }
+
+private:
+  // p 到线段 ab 的距离，用线段不用直线，曲线在弦内折回时也能分出来
+  static double distance(const Vector2d& p, const Vector2d& a, const Vector2d& b){
+    Vector2d ab = b - a;
+    double len = ab.squaredNorm();
+    double u = len > 0 ? std::clamp((p - a).dot(ab) / len, 0.0, 1.0) : 0.0;
+    return (p - (a + u * ab)).norm();
+  }
+
+  // 采样点都在画布同一边以外，就当这一段整个在外面，和判平直一样只看采样点
+  bool outside(std::initializer_list<Vector2d > ps) const {
+    if(ww <= 0 || hh <= 0){
+      return false;
+    }
+    bool left = true, right = true, top = true, bottom = true;
+    for(auto& p : ps){
+      left &= p.x() < -tol;
+      right &= p.x() > ww + tol;
+      top &= p.y() < -tol;
+      bottom &= p.y() > hh + tol;
+    }
+    return left || right || top || bottom;
+  }
+
+  // 输出 (t0, t1] 上的采样点，a、m、b 是两端和中点已经求好的点；
+  // 中点和两个四分点都离弦不超过 tol 才算平，四分点正好是两半的中点，分下去不用重算
+  template<class F >
+  void divide(F& f, double t0, const Vector2d& a, const Vector2d& m, double t1, const Vector2d& b, int depth, vecf& xs, vecf& ys) const {
+    if(depth > 0 && a.allFinite() && m.allFinite() && b.allFinite()){
+      double tm = (t0 + t1) / 2;
+      Vector2d q0 = f((t0 + tm) / 2), q1 = f((tm + t1) / 2);
+      bool flat = distance(m, a, b) <= tol && distance(q0, a, b) <= tol && distance(q1, a, b) <= tol;
+      if(!flat && !outside({a, q0, m, q1, b})){
+        divide(f, t0, a, q0, tm, m, depth - 1, xs, ys);
+        divide(f, tm, m, q1, t1, b, depth - 1, xs, ys);
+        return;
+      }
+    }
+    xs.push_back(b.x());
+    ys.push_back(b.y());
+  }
+};
+
+
+class Simplifier{
+  // Douglas-Peucker 化简：采样点变成 Figure 之前，去掉离化简后折线不到 tol 的点，
+  // 化简前后的折线处处相差不超过 tol，取小于一个像素格就看不出区别
+  // 递归改成显式栈，标记数组和栈都留着复用
+  vector<char > keep;
+  vector<pair<int, int > > stack;
+  long before = 0, after = 0; // 累计化简前后的点数
+
+  // (a, b) 之间离线段 ab 最远的点，都不超过 tol 时返回 -1
+  // 比较的是距离的平方；坐标有 NaN 时距离也是 NaN，这样的点当作无穷远，总会留下
+  int farthest(const vecf& xs, const vecf& ys, int a, int b) const {
+    double ax = xs[a], ay = ys[a], dx = xs[b] - ax, dy = ys[b] - ay;
+    double len = dx * dx + dy * dy, inv = len > 0 ? 1 / len : 0;
+    int far = -1;
+    double farDist = tol * tol;
+    for(int i = a + 1; i < b; i ++){
+      double px = xs[i] - ax, py = ys[i] - ay;
+      double u = std::clamp((px * dx + py * dy) * inv, 0.0, 1.0);
+      double ex = px - u * dx, ey = py - u * dy, d = ex * ex + ey * ey;
+      if(!(d <= farDist)){
+        far = i;
+        farDist = std::isnan(d) ? std::numeric_limits<double >::infinity() : d;
+      }
+    }
+    return far;
+  }
+
+public:
+  double tol;
+  bool enabled = true;
+
+  explicit Simplifier(double _tol = 0.75) : tol{_tol} {}
+
+  // 原地化简 xs, ys，首尾两个点总是保留，闭合折线首尾之间那条边也不变
+  void run(vecf& xs, vecf& ys){
+    ScopedTimer timer(Profiler::Simplify);
+    int n = xs.size();
+    before += n;
+    if(!enabled || n <= 2){
+      after += n;
+      return;
+    }
+    keep.assign(n, 0);
+    keep[0] = keep[n - 1] = 1;
+    stack.clear();
+    stack.push_back({0, n - 1});
+    while(!stack.empty()){
+      auto [a, b] = stack.back();
+      stack.pop_back();
+      int far = farthest(xs, ys, a, b);
+      if(far != -1){
+        keep[far] = 1;
+        stack.push_back({a, far});
+        stack.push_back({far, b});
+      }
+    }
+    int m = 0;
+    for(int i = 0; i < n; i ++){
+      if(keep[i]){
+        xs[m] = xs[i];
+        ys[m] = ys[i];
+        m ++;
+      }
+    }
+    xs.resize(m);
+    ys.resize(m);
+    after += m;
+  }
+
+  long beforeCount() const { return before; }
+  long afterCount() const { return after; }
+};
+
+class Circle : public Figure{
+  int x = 0, y = 0, r0 = 0, r = 0;
+
+  // 抗锯齿的图案：d 是像素中心到圆心的距离，外圈覆盖率 r + 0.5 - d，有内圈时再乘上 d - r0 + 0.5，都夹到 [0, 1]
+  // 整个盖满的像素照样按行合并成 spans，只盖住一部分的放进 soft
+  static void smoothSprite(Sprite& sprite, int r, int r0){
+    sprite.top = sprite.left = r + 1;
+    sprite.bottom = sprite.right = - r - 1;
+    for(int dy = - r - 1; dy <= r + 1; dy ++){
+      int runBegin = 0;
+      bool inRun = false;
+      for(int dx = - r - 1; dx <= r + 1; dx ++){
+        double d = std::sqrt(double(pp(dx) + pp(dy)));
+        double a = std::clamp(r + 0.5 - d, 0.0, 1.0) * (r0 > 0 ? std::clamp(d - r0 + 0.5, 0.0, 1.0) : 1.0);
+        int cover = int(a * 255 + 0.5);
+        if(cover == 255){
+          sprite.blocks.push_back({dx, dy});
+          if(!inRun){
+            runBegin = dx;
+            inRun = true;
+          }
+        }
+        else{
+          if(inRun){
+            sprite.spans.push_back({dy, runBegin, dx});
+            inRun = false;
+          }
+          if(cover > 0){
+            sprite.soft.push_back({dx, dy, uint8_t(cover)});
+          }
+        }
+        if(cover > 0){
+          sprite.top = min(sprite.top, dy);
+          sprite.bottom = max(sprite.bottom, dy + 1);
+          sprite.left = min(sprite.left, dx);
+          sprite.right = max(sprite.right, dx + 1);
+        }
+      }
+      if(inRun){
+        sprite.spans.push_back({dy, runBegin, r + 2});
+      }
+    }
+    if(sprite.top >= sprite.bottom){
+      sprite.top = sprite.bottom = sprite.left = sprite.right = 0;
+    }
+  }
+
+  // 同样的 r, r0, pixelSize 只算一次，控制点每帧都直接用
+  static const Sprite& getSprite(int r, int r0, int pixelSize){
+    std::tuple<int, int, int > key{r, r0, pixelSize};
+    thread_local std::tuple<int, int, int > lastKey{-1, -1, -1};
+    thread_local const Sprite* last = nullptr;
+    if(key == lastKey){
+      return *last;
+    }
+
+    static std::mutex mutex;
+    static std::map<std::tuple<int, int, int >, Sprite > cache;
+    std::lock_guard<std::mutex > lock(mutex);
+    auto [it, inserted] = cache.try_emplace(key);
+    Sprite& sprite = it -> second;
+    lastKey = key;
+    last = &sprite;
+    if(!inserted){
+      return sprite;
+    }
+    if(pixelSize == 1){
+      smoothSprite(sprite, r, r0);
+      return sprite;
+    }
+
+    int begin = - r / pixelSize * pixelSize;
+    sprite.top = begin;
+    sprite.bottom = begin;
+    for(int dy = begin; dy <= r; dy += pixelSize){
+      int runBegin = 0, runEnd = 0; // 当前这一段连续的块 [runBegin, runEnd)
+      bool inRun = false;
+      for(int dx = begin; dx <= r; dx += pixelSize){
+        if(pp(dx) + pp(dy) <= pp(r) && pp(dx) + pp(dy) >= pp(r0)){
+          sprite.blocks.push_back({dx, dy});
+          if(inRun && runEnd == dx){
+            runEnd = dx + pixelSize;
+          }
+          else{
+            if(inRun){
+              for(int k = 0; k < pixelSize; k ++){
+                sprite.spans.push_back({dy + k, runBegin, runEnd});
+              }
+            }
+            runBegin = dx;
+            runEnd = dx + pixelSize;
+            inRun = true;
+          }
+        }
+      }
+      if(inRun){
+        for(int k = 0; k < pixelSize; k ++){
+          sprite.spans.push_back({dy + k, runBegin, runEnd});
+        }
+        sprite.bottom = dy + pixelSize;
+      }
+      else if(sprite.blocks.empty()){
+        sprite.top = dy + pixelSize;
+      }
+    }
+    // 圆是对称的，列的范围和行一样
+    sprite.left = sprite.top;
+    sprite.right = sprite.bottom;
+    return sprite;
+  }
+
+public:
+  Circle(int _x, int _y, Vector4i _color, int _r, int _r0 = 0)
+    : Figure{_color}, x{_x}, y{_y}, r0{_r0}, r{_r} {}
+
+  void makePaintList(PaintList& list, int pixelSize) const override { 
+    const Sprite& sprite = getSprite(r, r0, pixelSize);
+    if(pixelSize == 1){
+      for(auto [dx, dy] : sprite.blocks){
+        list.push(x + dx, y + dy, 255);
+      }
+      for(auto& soft : sprite.soft){
+        list.push(x + soft.dx, y + soft.dy, soft.a);
+      }
+      return;
+    }
+    for(auto [dx, dy] : sprite.blocks){
+      list.push(x + dx, y + dy);
+    }
+  }
+
+  Stamp getStamp(int pixelSize) const override {
+    return {&getSprite(r, r0, pixelSize), x, y};
+  }
+  ~Circle() override {};
+};
+
+class WorkerPool{
+  // 固定几个工作线程，run(n, f) 把 f(0) ... f(n - 1) 分给它们和调用线程一起做，做完才返回
+  vector<std::thread > threads;
+  std::mutex mutex;
+  std::condition_variable wake, finished;
+  // run 的 f，只存指针和调用它的函数，不包成 std::function（捕获多了会分配内存）
+  const void* task = nullptr;
+  void (*call)(const void*, int) = nullptr;
+  int taskNum = 0, busy = 0;
+  long generation = 0;
+  std::atomic<int > next{0};
+  bool quit = false;
+
+  void work(){
+    int i;
+    while((i = next.fetch_add(1)) < taskNum){
+      call(task, i);
+    }
+  }
+
+  void loop(){
+    Trace::nameThread("worker");
+    Profiler::pipelineThread = true;
+    long seen = 0;
+    while(true){
+      {
+        std::unique_lock<std::mutex > lock(mutex);
+        wake.wait(lock, [&]{ return quit || generation != seen; });
+        if(quit){
+          return;
+        }
+        seen = generation;
+      }
+      work();
+      std::lock_guard<std::mutex > lock(mutex);
+      if(-- busy == 0){
+        finished.notify_one();
+      }
+    }
+  }
+
+public:
+  explicit WorkerPool(int num = int(std::thread::hardware_concurrency()) - 1){
+    for(int i = 0; i < num; i ++){
+      threads.emplace_back([this]{ loop(); });
+    }
+  }
+
+  ~WorkerPool(){
+    {
+      std::lock_guard<std::mutex > lock(mutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for(auto& t : threads){
+      t.join();
+    }
+  }
+
+  int size() const { return threads.size() + 1; }
+
+  template<class F >
+  void run(int n, const F& f){
+    if(threads.empty() || n <= 1){
+      for(int i = 0; i < n; i ++){
+        f(i);
+      }
+      return;
+    }
+    {
+      std::lock_guard<std::mutex > lock(mutex);
+      task = &f;
+      call = [](const void* p, int i){ (*static_cast<const F* >(p))(i); };
+      taskNum = n;
+      next = 0;
+      busy = threads.size();
+      generation ++;
+    }
+    wake.notify_all();
+    work();
+    std::unique_lock<std::mutex > lock(mutex);
+    finished.wait(lock, [&]{ return busy == 0; });
+  }
+
+  // instance() 的工作线程数，第一次调 instance() 之前改才有用，比如无界面模式的 --threads
+  inline static int defaultNum = int(std::thread::hardware_concurrency()) - 1;
+
+  static WorkerPool& instance(){
+    static WorkerPool pool(defaultNum);
+    return pool;
+  }
+};
+
+struct Rect{
+  // 屏幕上的一块矩形 [x0, x1) x [y0, y1)
+  int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+};
+
+struct Raster{
+  // 一组 Figure 光栅化的中间结果：每个 Figure 的贴图，或者按 Canvas::tileH 行一块切开的像素，和生成时的画布大小
+  // 按 Canvas::composite 合成，Figure 没变、画布大小没变就可以一直复用
+  // 没有贴图的第 i 个 Figure 在第 b 块里的像素是 lists[slots[i] + b]，跨两块的方块两块里都有
+  vector<PaintList > lists; // 多出来的留着容量
+  vector<long > owned; // 和 lists 一一对应：左上角在这一块里的方块数，跨块的方块只算一次
+  vector<int > slots; // 有贴图的是 -1
+  vector<Stamp > stamps;
+  vector<uint32_t > colors;
+  int ww = -1, hh = -1, pixelSize = 0, bands = 0;
+  // 按 Canvas::dirtyTile 分块的像素签名，每块一个哈希，块里画的东西没变哈希就不变
+  // LayeredScene 拿前后两帧的签名比较，算出要重绘的区域
+  vector<uint64_t > tiles;
+
+  // 一共画了多少像素：贴图按图案的像素数，PaintList 每个点是 pixelSize x pixelSize 的方块
+  long pixelCount() const {
+    long n = 0;
+    for(size_t i = 0; i < stamps.size(); i ++){
+      if(const Sprite* sprite = stamps[i].sprite){
+        for(auto& span : sprite -> spans){
+          n += span.dx1 - span.dx0;
+        }
+        n += sprite -> soft.size();
+      }
+      else{
+        for(int b = 0; b < bands; b ++){
+          n += owned[slots[i] + b] * pixelSize * pixelSize;
+        }
+      }
+    }
+    return n;
+  }
+};
+
+struct PrepareJob{
+  // Canvas::prepare 里一起生成的一组 Figure 和存结果的 Raster
+  const vector<std::shared_ptr<Figure > >* figures;
+  Raster* raster;
+};
+
+class Canvas{
+  // 软件帧缓冲，预乘 alpha 的 ARGB32，和 QImage::Format_ARGB32_Premultiplied 的内存布局一致
+  // Figure 的像素直接写进来，每帧只交给 QPainter 一次
+  // pixelSize 为 1 时是全分辨率抗锯齿：线和圆的边缘按覆盖率和底下的像素混合
+  int ww = 0, hh = 0;
+  vector<uint32_t > buffer;
+  PaintList paintList; // 单个 Figure 用它，不用每次重新分配
+  Raster raster; // drawAll 用它，帧间复用
+  vector<PrepareJob > jobs; // 只生成一组时用，帧间复用
+  static constexpr int tileH = 64; // 分块的行数
+  // 按 dirtyTile 分块，记着哪些块上一次合成时画过东西；其他块一直是全透明的，下一次合成不用再清
+  // 曲线只占画布的一小部分，这样每帧不用把整块画布都清一遍
+  vector<char > inked, nextInked;
+
+  // 只写 [rowBegin, rowEnd) 这些行
+  void fillBlock(int x, int y, int pixelSize, uint32_t argb, int rowBegin, int rowEnd){
+    int x1 = min(ww, x + pixelSize), y1 = min(rowEnd, y + pixelSize);
+    x = max(0, x);
+    y = max(rowBegin, y);
+    for(int j = y; j < y1; j ++){
+      std::fill(buffer.begin() + size_t(j) * ww + x, buffer.begin() + size_t(j) * ww + x1, argb);
+    }
+  }
+
+  // 按覆盖率 a（0 ~ 255）把不透明的 argb 叠到 dst 上：dst = argb * a / 255 + dst * (255 - a) / 255
+  // 预乘格式下四个通道算法一样，两个通道一组放进一个 32 位整数里一起乘；
+  // 除以 255 用 (t + (t >> 8)) >> 8 代替，t 先加上 128 四舍五入，a 为 255 时结果正好是 argb
+  static uint32_t blend(uint32_t dst, uint32_t argb, uint32_t a){
+    uint32_t b = 255 - a;
+    uint32_t rb = (argb & 0xff00ff) * a + (dst & 0xff00ff) * b + 0x800080;
+    uint32_t ag = (argb >> 8 & 0xff00ff) * a + (dst >> 8 & 0xff00ff) * b + 0x800080;
+    rb = (rb + (rb >> 8 & 0xff00ff)) >> 8 & 0xff00ff;
+    ag = (ag + (ag >> 8 & 0xff00ff)) & 0xff00ff00;
+    return ag | rb;
+  }
+
+  // 只写 [rowBegin, rowEnd) 这些行
+  void stamp(const Stamp& st, uint32_t argb, int rowBegin, int rowEnd){
+    for(auto& span : st.sprite -> spans){
+      int y = st.y + span.dy;
+      if(y < rowBegin || y >= rowEnd){
+        continue;
+      }
+      int x0 = max(0, st.x + span.dx0), x1 = min(ww, st.x + span.dx1);
+      if(x0 < x1){
+        std::fill_n(buffer.begin() + size_t(y) * ww + x0, x1 - x0, argb);
+      }
+    }
+    for(auto& soft : st.sprite -> soft){
+      int x = st.x + soft.dx, y = st.y + soft.dy;
+      if(y >= rowBegin && y < rowEnd && x >= 0 && x < ww){
+        uint32_t& dst = buffer[size_t(y) * ww + x];
+        dst = blend(dst, argb, soft.a);
+      }
+    }
+  }
+
+  // 只写 [rowBegin, rowEnd) 这些行
+  void fillList(const PaintList& list, int pixelSize, int rowBegin, int rowEnd){
+    int m = list.size();
+    if(!list.a.empty()){
+      // 抗锯齿的像素每个只出现一次，直接混合
+      for(int k = 0; k < m; k ++){
+        int y = list.y[k];
+        if(y >= rowBegin && y < rowEnd){
+          uint32_t& dst = buffer[size_t(y) * ww + list.x[k]];
+          dst = blend(dst, list.color, list.a[k]);
+        }
+      }
+      return;
+    }
+    for(int k = 0; k < m; k ++){
+      int y = list.y[k];
+      if(y < rowEnd && y + pixelSize > rowBegin){
+        fillBlock(list.x[k], y, pixelSize, list.color, rowBegin, rowEnd);
+      }
+    }
+  }
+
+  // 第 band 块，只写 [rowBegin, rowEnd) 这些行；PaintList 只看这一块的，贴图碰不到这几行的直接跳过
+  void fillBand(const Raster& raster, int band, int rowBegin, int rowEnd){
+    for(int i = 0; i < int(raster.stamps.size()); i ++){
+      const Stamp& st = raster.stamps[i];
+      if(st.sprite){
+        if(st.y + st.sprite -> top < rowEnd && st.y + st.sprite -> bottom > rowBegin){
+          stamp(st, raster.colors[i], rowBegin, rowEnd);
+        }
+      }
+      else if(band < raster.bands){
+        fillList(raster.lists[raster.slots[i] + band], raster.pixelSize, rowBegin, rowEnd);
+      }
+    }
+  }
+
+  // 把 [rowBegin, rowEnd) 这些行里上一次画过东西的块清成全透明，同一行里连着的块一起清
+  void clearInked(int rowBegin, int rowEnd){
+    static_assert(tileH % dirtyTile == 0, "分块的行要正好是整数个 dirtyTile");
+    int tilesX = tileCols();
+    for(int y0 = rowBegin; y0 < rowEnd; y0 += dirtyTile){
+      const char* row = inked.data() + size_t(y0 / dirtyTile) * tilesX;
+      int y1 = min(rowEnd, y0 + dirtyTile);
+      for(int tx = 0; tx < tilesX; ){
+        if(!row[tx]){
+          tx ++;
+          continue;
+        }
+        int end = tx;
+        while(end < tilesX && row[end]){
+          end ++;
+        }
+        int x0 = tx * dirtyTile, x1 = min(ww, end * dirtyTile);
+        for(int y = y0; y < y1; y ++){
+          std::fill(buffer.begin() + size_t(y) * ww + x0, buffer.begin() + size_t(y) * ww + x1, 0);
+        }
+        tx = end;
+      }
+    }
+  }
+
+  // 把一个块 [x0, x1) x [y0, y1) 的哈希加进它碰到的每个分块
+  // 用加法，和 Figure 里像素的先后顺序无关；同一层的 Figure 颜色相同时先后本来也不影响结果
+  void signBlock(Raster& raster, int x0, int y0, int x1, int y1, uint64_t h){
+    x0 = max(0, x0);
+    y0 = max(0, y0);
+    x1 = min(ww, x1);
+    y1 = min(hh, y1);
+    if(x0 >= x1 || y0 >= y1){
+      return;
+    }
+    int tilesX = tileCols();
+    for(int ty = y0 / dirtyTile; ty <= (y1 - 1) / dirtyTile; ty ++){
+      for(int tx = x0 / dirtyTile; tx <= (x1 - 1) / dirtyTile; tx ++){
+        raster.tiles[size_t(ty) * tilesX + tx] += h;
+      }
+    }
+  }
+
+  void signStamps(Raster& raster){
+    for(int i = 0; i < int(raster.stamps.size()); i ++){
+      auto& st = raster.stamps[i];
+      if(st.sprite){
+        uint64_t color = uint64_t(raster.colors[i]) << 32;
+        uint64_t h = mix(color ^ reinterpret_cast<uintptr_t >(st.sprite) ^ mix(uint64_t(uint32_t(st.x)) << 32 | uint32_t(st.y)));
+        signBlock(raster, st.x + st.sprite -> left, st.y + st.sprite -> top, st.x + st.sprite -> right, st.y + st.sprite -> bottom, h);
+      }
+    }
+  }
+
+  // 一块 PaintList 的签名，只加到 [rowBegin, rowEnd) 这几行的分块上；
+  // 跨两块的方块在两块里各加各的那几行，合起来和整个方块一起加一样
+  void signRows(Raster& raster, const PaintList& list, int rowBegin, int rowEnd){
+    uint64_t color = uint64_t(list.color) << 32;
+    if(!list.a.empty()){
+      // 抗锯齿的像素只有一个，直接算出它在哪一块
+      // 覆盖率放在最高字节，那里原本是颜色的 alpha，总是 0xff，异或上去不会和别的像素撞
+      int tilesX = tileCols();
+      for(int k = 0; k < int(list.size()); k ++){
+        int x = list.x[k], y = list.y[k];
+        uint64_t h = mix(color ^ (uint64_t(list.a[k]) << 56) ^ (uint64_t(uint32_t(x)) << 16) ^ uint32_t(y));
+        raster.tiles[size_t(y / dirtyTile) * tilesX + x / dirtyTile] += h;
+      }
+      return;
+    }
+    int pixelSize = raster.pixelSize;
+    for(int k = 0; k < int(list.size()); k ++){
+      int x = list.x[k], y = list.y[k];
+      signBlock(raster, x, max(y, rowBegin), x + pixelSize, min(y + pixelSize, rowEnd), mix(color ^ (uint64_t(uint32_t(x)) << 16) ^ uint32_t(y)));
+    }
+  }
+
+public:
+  static constexpr int dirtyTile = 32; // 脏区域按这么大的方块算
+
+  // splitmix64 的收尾，把输入打散到 64 位
+  static uint64_t mix(uint64_t h){
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+  }
+
+  int tileCols() const { return (ww + dirtyTile - 1) / dirtyTile; }
+  int tileRows() const { return (hh + dirtyTile - 1) / dirtyTile; }
+
+  // 大小变了返回 true，此时内容已经清空
+  bool resize(int _ww, int _hh){
+    if(ww == _ww && hh == _hh){
+      return false;
+    }
+    ww = _ww;
+    hh = _hh;
+    // 内存只增不减：变小时 assign 不释放，变大时多留四分之一，窗口来回改大小不用每次重新分配
+    size_t size = size_t(max(ww, 0)) * max(hh, 0);
+    if(size > buffer.capacity()){
+      buffer.clear();
+      buffer.reserve(size + size / 4);
+    }
+    buffer.assign(size, 0);
+    inked.assign(size_t(tileCols()) * tileRows(), 0);
+    return true;
+  }
+
+  void clear(){
+    // 全透明，露出窗口背景
+    std::fill(buffer.begin(), buffer.end(), 0);
+    std::fill(inked.begin(), inked.end(), 0);
+  }
+
+  void fillBlock(int x, int y, int pixelSize, uint32_t argb){
+    std::fill(inked.begin(), inked.end(), 1); // 不按分块记，下次合成整个清掉
+    fillBlock(x, y, pixelSize, argb, 0, hh);
+  }
+
+  void draw(const Figure& figure, int pixelSize){
+    std::fill(inked.begin(), inked.end(), 1);
+    Stamp st = figure.getStamp(pixelSize);
+    if(st.sprite){
+      stamp(st, figure.getColor(), 0, hh);
+      return;
+    }
+    figure.getPaintList(paintList, ww, hh, pixelSize);
+    fillList(paintList, pixelSize, 0, hh);
+  }
+
+  // 生成几组 Figure 的像素（或贴图），各自存进自己的 raster 里，可以缓存起来反复合成
+  // 贴图直接记下；其他 Figure 按 tileH 行一块切开，每块一个任务，生成、签名所有组所有 Figure 在这几行里的像素。
+  // 只分一次任务：一条曲线也能分给好几个线程，几层一起变了也不用一层一层等；
+  // 签名的分块不跨块，各任务不用加锁。合成时每块也只碰自己的像素
+  void prepare(const vector<PrepareJob >& jobs, int pixelSize){
+    int bands = (hh + tileH - 1) / tileH;
+    bool anyList = false;
+    for(auto& job : jobs){
+      const auto& figures = *job.figures;
+      Raster& raster = *job.raster;
+      int n = figures.size(), listNum = 0;
+      raster.slots.resize(n);
+      raster.stamps.resize(n);
+      raster.colors.resize(n);
+      raster.ww = ww;
+      raster.hh = hh;
+      raster.pixelSize = pixelSize;
+      raster.bands = bands;
+      for(int i = 0; i < n; i ++){
+        raster.colors[i] = figures[i] -> getColor();
+        raster.stamps[i] = figures[i] -> getStamp(pixelSize);
+        raster.slots[i] = raster.stamps[i].sprite ? -1 : listNum ++ * bands;
+      }
+      anyList |= listNum > 0;
+      if(raster.lists.size() < size_t(listNum) * bands){
+        raster.lists.resize(size_t(listNum) * bands);
+      }
+      raster.owned.resize(size_t(listNum) * bands);
+      raster.tiles.assign(size_t(tileCols()) * tileRows(), 0);
+    }
+    WorkerPool::instance().run(anyList ? bands : 0, [&](int b){
+      int rowBegin = b * tileH, rowEnd = min(hh, rowBegin + tileH);
+      for(auto& job : jobs){
+        const auto& figures = *job.figures;
+        Raster& raster = *job.raster;
+        for(int i = 0; i < int(figures.size()); i ++){
+          if(raster.slots[i] < 0){
+            continue;
+          }
+          PaintList& list = raster.lists[raster.slots[i] + b];
+          figures[i] -> getPaintList(list, ww, hh, pixelSize, rowBegin, rowEnd);
+          raster.owned[raster.slots[i] + b] = std::count_if(list.y.begin(), list.y.end(), [&](int y){ return y >= rowBegin; });
+          signRows(raster, list, rowBegin, rowEnd);
+        }
+      }
+    });
+    for(auto& job : jobs){
+      signStamps(*job.raster);
+    }
+  }
+
+  void prepare(const vector<std::shared_ptr<Figure > >& figures, int pixelSize, Raster& raster){
+    jobs.assign(1, {&figures, &raster});
+    prepare(jobs, pixelSize);
+  }
+
+  // 清屏并按顺序把几层 raster 合成上去，后面的层盖住前面的
+  // 屏幕按 tileH 行分块，和 prepare 切 PaintList 的块一样，各块并行填充，互不重叠所以不用加锁
+  void composite(const vector<const Raster* >& rasters){
+    // 这一次要画东西的块：哪一层在这块的签名不为 0 就是画了东西
+    // （签名是像素哈希的和，画了东西却正好加成 0 的概率可以不管）
+    nextInked.assign(inked.size(), 0);
+    for(auto raster : rasters){
+      if(raster -> tiles.size() != nextInked.size()){
+        std::fill(nextInked.begin(), nextInked.end(), 1); // 不是按这个画布大小生成的，不知道画在哪，保守一点
+        continue;
+      }
+      for(size_t t = 0; t < nextInked.size(); t ++){
+        nextInked[t] |= raster -> tiles[t] != 0;
+      }
+    }
+
+    int tileNum = (hh + tileH - 1) / tileH;
+    WorkerPool::instance().run(tileNum, [&](int t){
+      int rowBegin = t * tileH, rowEnd = min(hh, rowBegin + tileH);
+      clearInked(rowBegin, rowEnd);
+      for(auto raster : rasters){
+        fillBand(*raster, t, rowBegin, rowEnd);
+      }
+    });
+    inked.swap(nextInked);
+  }
+
+  // 清屏并按顺序画完所有 Figure，结果和逐个 draw 完全一样
+  void drawAll(const vector<std::shared_ptr<Figure > >& figures, int pixelSize){
+    prepare(figures, pixelSize, raster);
+    composite({&raster});
+  }
+
+  int width() const { return ww; }
+  int height() const { return hh; }
+  const uint32_t* data() const { return buffer.data(); }
+};
+
+class FrameArena : public std::pmr::memory_resource{
+  // 一帧内的 Figure 都从这里分配：在一整块内存上往后挪指针，释放什么都不做
+  // 帧结束时 reset() 整块回收；块不够用时才向全局堆要，并把下一帧的块加大
+  vector<std::byte > block;
+  size_t used = 0, overflow = 0;
+  struct Spill{ void* p; size_t bytes, align; };
+  vector<Spill > spills; // 本帧向全局堆要的内存
+  long heapAllocs = 0;
+
+  void* do_allocate(size_t bytes, size_t align) override {
+    size_t begin = (used + align - 1) / align * align;
+    if(begin + bytes <= block.size()){
+      used = begin + bytes;
+      return block.data() + begin;
+    }
+    heapAllocs ++;
+    overflow += bytes + align;
+    void* p = ::operator new(bytes, std::align_val_t(align));
+    spills.push_back({p, bytes, align});
+    return p;
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  FrameArena(size_t bytes = 1 << 16) : block(bytes) {}
+  FrameArena(const FrameArena&) = delete;
+  FrameArena& operator=(const FrameArena&) = delete;
+  ~FrameArena() override { reset(); }
+
+  void reset(){
+    for(auto& spill : spills){
+      ::operator delete(spill.p, spill.bytes, std::align_val_t(spill.align));
+    }
+    spills.clear();
+    if(overflow){
+      heapAllocs ++;
+      block = vector<std::byte >((block.size() + overflow) * 2);
+    }
+    used = overflow = 0;
+  }
+
+  // 累计向全局堆申请的次数，稳定拖拽时应该不再增长
+  long heapAllocCount() const { return heapAllocs; }
+};
+
+class Scene{
+  // 当前帧要画的 Figure，画完也保留着，窗口被遮挡后重绘时直接用
+  // Figure 都分配在 arena 里，新的一帧开始时 clear() 整块作废旧帧
+  // vector 的容量和 arena 的内存都留着下一帧复用，内存不会越积越多
+  // 注意：clear() 之后不要再持有旧帧 Figure 的 shared_ptr
+  FrameArena arena;
+  vector<std::shared_ptr<Figure > > figures;
+  bool dirty = true;
+
+public:
+  void clear(){
+    figures.clear();
+    arena.reset();
+    dirty = true;
+  }
+
+  // T 声明了 allocator_type（比如 Polyline）时，polymorphic_allocator 构造它会把 arena 也传进去，
+  // T 自己的数据也分配在 arena 里
+  template<class T, class... Args >
+  void add(Args&&... args){
+    figures.push_back(std::allocate_shared<T >(std::pmr::polymorphic_allocator<T >(&arena), std::forward<Args >(args)...));
+    dirty = true;
+  }
+
+  // 标记需要重新光栅化，比如窗口大小变了
+  void invalidate(){
+    dirty = true;
+  }
+
+  bool isDirty() const { return dirty; }
+  size_t size() const { return figures.size(); }
+  long heapAllocCount() const { return arena.heapAllocCount(); }
+  const vector<std::shared_ptr<Figure > >& getFigures() const { return figures; }
+
+  void rasterize(Canvas& canvas, int pixelSize){
+    canvas.drawAll(figures, pixelSize);
+    dirty = false;
+  }
+};
+
+struct Viewport{
+  // 世界坐标到屏幕坐标：screen = (world - (x, y)) * scale
+  // 控制点和曲线都在世界坐标里，画之前才换到屏幕上，缩放、平移只改这三个数
+  double x = 0, y = 0, scale = 1;
+
+  Vector2d toScreen(double wx, double wy) const {
+    return Vector2d((wx - x) * scale, (wy - y) * scale);
+  }
+
+  Vector2d toWorld(double sx, double sy) const {
+    return Vector2d(sx / scale + x, sy / scale + y);
+  }
+
+  // 以屏幕上的 (sx, sy) 为中心缩放，这一点下面的世界坐标不变
+  void zoom(double factor, double sx, double sy){
+    Vector2d w = toWorld(sx, sy);
+    scale = std::clamp(scale * factor, 1e-6, 1e6);
+    x = w.x() - sx / scale;
+    y = w.y() - sy / scale;
+  }
+
+  // 画面跟着鼠标移动 (dx, dy) 个屏幕像素
+  void pan(double dx, double dy){
+    x -= dx / scale;
+    y -= dy / scale;
+  }
+
+  // 控制点画成圆：圆整个在画布外面的不画，缩小后落进同一个像素格的只画第一个，
+  // 点再多，画出来的圆也不会超过画布的格子数
+  template<class Vec >
+  void addCircles(Scene& layer, const Vec& xs, const Vec& ys, const Vector4i& color, int r, int ww, int hh, int pixelSize) const {
+    int cols = ww / pixelSize + 1, rows = hh / pixelSize + 1;
+    thread_local vector<char > seen;
+    seen.assign(size_t(cols) * rows, 0);
+    for(size_t i = 0; i < xs.size(); i ++){
+      Vector2d p = toScreen(xs[i], ys[i]);
+      if(!(p.x() > -r && p.x() < ww + r && p.y() > -r && p.y() < hh + r)){
+        continue;
+      }
+      if(p.x() >= 0 && p.x() < ww && p.y() >= 0 && p.y() < hh){
+        char& cell = seen[size_t(p.y() / pixelSize) * cols + size_t(p.x() / pixelSize)];
+        if(cell){
+          continue;
+        }
+        cell = 1;
+      }
+      layer.add<Circle >(std::lround(p.x()), std::lround(p.y()), color, r);
+    }
+  }
+};
+
+class SpanTree{
+  // 世界坐标下的长折线，按下标二分建一棵包围盒树，控制点不变就一直用；
+  // 换视图时从根往下走：一段整个在画布同一边以外，或者在屏幕上还不到 tol 大，就只留它的首尾两个点，
+  // 否则往下分，到叶子才逐点输出。放大时画布外的大段直接跳过，缩小时细节一整段一整段地合并，
+  // 输出的点数只和看得到、看得清的部分有关
+  struct Box{ float x0, y0, x1, y1; };
+  static constexpr int leaf = 16; // 叶子最多这么多条线段
+  vecf xs, ys;
+  vector<Box > boxes; // 节点 k 的两个孩子是 2k + 1, 2k + 2
+
+  Box build(int k, int a, int b){
+    Box box;
+    if(b - a <= leaf){
+      box = {xs[a], ys[a], xs[a], ys[a]};
+      for(int i = a + 1; i <= b; i ++){
+        box = {min(box.x0, xs[i]), min(box.y0, ys[i]), max(box.x1, xs[i]), max(box.y1, ys[i])};
+      }
+    }
+    else{
+      int m = (a + b) / 2;
+      Box l = build(2 * k + 1, a, m), r = build(2 * k + 2, m, b);
+      box = {min(l.x0, r.x0), min(l.y0, r.y0), max(l.x1, r.x1), max(l.y1, r.y1)};
+    }
+    boxes[k] = box;
+    return box;
+  }
+
+  struct Walk{
+    const Viewport& view;
+    double ww, hh, margin, tol;
+    vecf& outX;
+    vecf& outY;
+  };
+
+  void push(Walk& w, int i) const {
+    Vector2d p = w.view.toScreen(xs[i], ys[i]);
+    w.outX.push_back(p.x());
+    w.outY.push_back(p.y());
+  }
+
+  // 输出 (a, b] 上的点，a 已经输出过了
+  void walk(Walk& w, int k, int a, int b) const {
+    const Box& box = boxes[k];
+    Vector2d lo = w.view.toScreen(box.x0, box.y0), hi = w.view.toScreen(box.x1, box.y1);
+    // 包围盒和画布不相交，就一定整个在画布某一边以外，首尾连成的弦也在那一边
+    bool outside = hi.x() < -w.margin || lo.x() > w.ww + w.margin || hi.y() < -w.margin || lo.y() > w.hh + w.margin;
+    // 包围盒不到 tol 大，弦离里面每个点都不到 tol
+    bool small = (hi - lo).norm() <= w.tol;
+    if(outside || small){
+      push(w, b);
+      return;
+    }
+    if(b - a <= leaf){
+      // 叶子里离上一个输出的点不到 tol 的点跳过，跳过的点离新连出来的线段也不到 tol；
+      // 叶子的最后一个点总是输出，上面“首尾相连”的判断要靠它
+      for(int i = a + 1; i < b; i ++){
+        Vector2d p = w.view.toScreen(xs[i], ys[i]);
+        if(pp(p.x() - w.outX.back()) + pp(p.y() - w.outY.back()) >= pp(w.tol)){
+          w.outX.push_back(p.x());
+          w.outY.push_back(p.y());
+        }
+      }
+      push(w, b);
+      return;
+    }
+    int m = (a + b) / 2;
+    walk(w, 2 * k + 1, a, m);
+    walk(w, 2 * k + 2, m, b);
+  }
+
+public:
+  uint64_t key = 0; // 建树用的输入的哈希，调用的人自己比较
+  bool built = false;
+
+  void build(vecf _xs, vecf _ys, uint64_t _key){
+    assert(_xs.size() == _ys.size());
+    xs = std::move(_xs);
+    ys = std::move(_ys);
+    key = _key;
+    built = true;
+    int n = xs.size();
+    boxes.resize(n > 1 ? 4 * ((n - 1) / leaf + 1) : 0);
+    if(n > 1){
+      build(0, 0, n - 1);
+    }
+  }
+
+  // 按 view 输出屏幕坐标的折线到 outX, outY；margin 是画布外还算看得到的宽度，tol 是允许的误差
+  void project(const Viewport& view, int ww, int hh, double margin, double tol, vecf& outX, vecf& outY) const {
+    ScopedTimer timer(Profiler::Sample);
+    outX.clear();
+    outY.clear();
+    int n = xs.size();
+    if(n == 0){
+      return;
+    }
+    Walk w{view, double(ww), double(hh), margin, tol, outX, outY};
+    push(w, 0);
+    if(n > 1){
+      walk(w, 0, 0, n - 1);
+    }
+  }
+};
+
+struct Hash{
+  // FNV-1a 的变体，给缓存算键用：Hash().add(a).add(b).value()
+  uint64_t h = 1469598103934665603ull;
+
+  // 8 个字节一组做异或、乘法，剩下的逐字节；控制点很多时也只要几毫秒
+  Hash& add(const void* data, size_t bytes){
+    auto p = static_cast<const unsigned char* >(data);
+    size_t i = 0;
+    for(; i + 8 <= bytes; i += 8){
+      uint64_t word;
+      std::memcpy(&word, p + i, 8);
+      h = (h ^ word) * 1099511628211ull;
+      h ^= h >> 32;
+    }
+    for(; i < bytes; i ++){
+      h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return *this;
+  }
+
+  template<class T >
+  Hash& add(const T& v){
+    static_assert(std::is_trivially_copyable<T >::value, "只能直接哈希平凡类型");
+    return add(&v, sizeof(v));
+  }
+
+  template<class T >
+  Hash& add(const vector<T >& v){
+    add(v.size());
+    return add(v.data(), v.size() * sizeof(T));
+  }
+
+  uint64_t value() const { return h; }
+};
+
+class CurveMemo{
+  // 采样、化简好的曲线（屏幕坐标）按输入的哈希存起来，最多 capacity 条，满了扔掉最久没用的那条。
+  // LayeredScene 每层只记得上一次的输入，参数调过去再调回来（比如 guassSigma 乘 2 再除 2）还得重新求解；
+  // 这里记着最近的几十条，回到之前的状态只要查一次表
+public:
+  struct Curve{
+    vecf x, y;
+  };
+
+private:
+  using Entry = pair<uint64_t, Curve >;
+  std::list<Entry > entries; // 最近用过的在前面
+  std::unordered_map<uint64_t, std::list<Entry >::iterator > index;
+  size_t capacity;
+  long hits = 0, misses = 0;
+
+public:
+  explicit CurveMemo(size_t _capacity = 64) : capacity{max(_capacity, size_t(1))} {}
+
+  // key 要包含曲线用到的全部输入：控制点、参数、视图、画布大小、pixelSize；
+  // id 区分同一组输入画出的不同曲线，一般就用层号。
+  // 没存过就调 make(x, y) 算出来存下。返回的引用到下一次 get 之前有效
+  template<class F >
+  const Curve& get(int id, uint64_t key, F&& make){
+    key = Hash().add(key).add(id).value();
+    auto it = index.find(key);
+    if(it != index.end()){
+      hits ++;
+      entries.splice(entries.begin(), entries, it -> second);
+      return it -> second -> second;
+    }
+    misses ++;
+    if(entries.size() >= capacity){
+      // 满了就把最久没用的那条挪到前面重用，vector 的内存和哈希表的节点也跟着重用
+      entries.splice(entries.begin(), entries, std::prev(entries.end()));
+      auto node = index.extract(entries.front().first);
+      node.key() = key;
+      node.mapped() = entries.begin();
+      index.insert(std::move(node));
+      entries.front().second.x.clear();
+      entries.front().second.y.clear();
+      entries.front().first = key;
+    }
+    else{
+      entries.emplace_front(key, Curve{});
+      index[key] = entries.begin();
+    }
+    Curve& curve = entries.front().second;
+    {
+      // 求解算在 solve 里，make 里面的采样、化简各算各的
+      ScopedTimer timer(Profiler::Solve);
+      make(curve.x, curve.y);
+    }
+    return curve;
+  }
+
+  size_t size() const { return entries.size(); }
+  long hitCount() const { return hits; }
+  long missCount() const { return misses; }
+};
+
+class LayeredScene{
+  // 分层缓存的 Scene：每层有自己的 Figure 和光栅化好的像素，外加一个输入的哈希。
+  // drawPoly 每帧用 layer(id, key) 取各层，哈希没变就返回 nullptr，直接沿用上次的 Figure；
+  // rasterize 只给重建过的层（或者画布大小变了的层）重新生成像素，然后按 id 顺序合成。
+  // 拖拽时没动到的曲线、控制点不会重算，代价只和变了的层有关
+  struct Layer{
+    Scene scene;
+    Raster raster;
+    uint64_t key = 0;
+    bool built = false; // 之前建过，key 有效
+    bool used = false; // 这一帧用到了
+    bool stale = true; // raster 需要重新生成
+  };
+  vector<std::unique_ptr<Layer > > layers; // Scene 里的 arena 不能移动，只能存指针
+  vector<const Raster* > order; // 合成顺序，帧间复用
+  vector<PrepareJob > jobs; // 这一帧要重新生成的层，帧间复用
+  long rebuilt = 0, reused = 0;
+  vector<uint64_t > shown, next; // 上一帧和这一帧合成结果的分块签名
+  int shownW = -1, shownH = -1;
+  vector<Rect > dirty;
+
+  // 逐块比较这一帧和上一帧的签名，变了的块按行合并成矩形放进 dirty
+  void diff(const Canvas& canvas){
+    int tilesX = canvas.tileCols(), tilesY = canvas.tileRows();
+    next.assign(size_t(tilesX) * tilesY, 0);
+    for(auto raster : order){
+      for(size_t t = 0; t < next.size(); t ++){
+        if(raster -> tiles[t]){
+          next[t] = Canvas::mix(next[t] + raster -> tiles[t]); // 和层的先后有关
+        }
+      }
+    }
+    bool resized = shownW != canvas.width() || shownH != canvas.height();
+    dirty.clear();
+    for(int ty = 0; ty < tilesY; ty ++){
+      for(int tx = 0; tx < tilesX; ){
+        size_t t = size_t(ty) * tilesX + tx;
+        if(!resized && next[t] == shown[t]){
+          tx ++;
+          continue;
+        }
+        int begin = tx;
+        while(tx < tilesX && (resized || next[size_t(ty) * tilesX + tx] != shown[size_t(ty) * tilesX + tx])){
+          tx ++;
+        }
+        dirty.push_back({begin * Canvas::dirtyTile, ty * Canvas::dirtyTile,
+          min(canvas.width(), tx * Canvas::dirtyTile), min(canvas.height(), (ty + 1) * Canvas::dirtyTile)});
+      }
+    }
+    shown.swap(next);
+    shownW = canvas.width();
+    shownH = canvas.height();
+  }
+
+public:
+  // 开始新的一帧，之后没有再 layer() 的层这一帧不画
+  void clear(){
+    for(auto& layer : layers){
+      layer -> used = false;
+    }
+  }
+
+  // 这一帧要画第 id 层，它的输入哈希是 key
+  // 需要重建时返回清空的 Scene，往里 add 就行；没变返回 nullptr
+  Scene* layer(int id, uint64_t key){
+    while(int(layers.size()) <= id){
+      layers.push_back(std::make_unique<Layer >());
+    }
+    Layer& layer = *layers[id];
+    layer.used = true;
+    if(layer.built && layer.key == key){
+      reused ++;
+      return nullptr;
+    }
+    rebuilt ++;
+    layer.key = key;
+    layer.built = true;
+    layer.stale = true;
+    layer.scene.clear();
+    return &layer.scene;
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for(auto& layer : layers){
+      n += layer -> used ? layer -> scene.size() : 0;
+    }
+    return n;
+  }
+
+  long rebuiltCount() const { return rebuilt; }
+  long reusedCount() const { return reused; }
+
+  // 最近一次 rasterize 画了多少像素
+  long pixelCount() const {
+    long n = 0;
+    for(auto& layer : layers){
+      n += layer -> used ? layer -> raster.pixelCount() : 0;
+    }
+    return n;
+  }
+
+  // 要重新生成的层一起交给 Canvas::prepare，只分一次任务，几层都变了也能同时算
+  void rasterize(Canvas& canvas, int pixelSize){
+    ScopedTimer timer(Profiler::Composite);
+    order.clear();
+    jobs.clear();
+    for(auto& ptr : layers){
+      Layer& layer = *ptr;
+      if(!layer.used){
+        continue;
+      }
+      Raster& raster = layer.raster;
+      if(layer.stale || raster.ww != canvas.width() || raster.hh != canvas.height() || raster.pixelSize != pixelSize){
+        jobs.push_back({&layer.scene.getFigures(), &raster});
+        layer.stale = false;
+      }
+      order.push_back(&raster);
+    }
+    if(!jobs.empty()){
+      ScopedTimer prepare(Profiler::Prepare);
+      canvas.prepare(jobs, pixelSize);
+    }
+    canvas.composite(order);
+    diff(canvas);
+  }
+
+  // 最近一次 rasterize 和它前一次相比画面变了的区域，画布大小变了就是整个画布
+  const vector<Rect >& dirtyRects() const { return dirty; }
+};
+
+template<class T, size_t N >
+class SpscRing{
+  // 单生产者单消费者的无锁环形队列：push 只在一个线程里调，pop 只在另一个线程里调，
+  // 两边各自只写自己的下标，靠 acquire/release 保证看到的元素是写完的
+  static_assert((N & (N - 1)) == 0, "N 必须是 2 的幂");
+  T items[N];
+  alignas(64) std::atomic<size_t > head{0}; // 下一个要读的位置，只有消费者写
+  alignas(64) std::atomic<size_t > tail{0}; // 下一个要写的位置，只有生产者写
+
+public:
+  // 满了返回 false
+  bool push(T item){
+    size_t t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) == N){
+      return false;
+    }
+    items[t & (N - 1)] = std::move(item);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // 空了返回 false
+  bool pop(T& item){
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire)){
+      return false;
+    }
+    item = std::move(items[h & (N - 1)]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+template<class Board >
+class RenderThread{
+  // 后台计算线程：drawPoly 里的数学计算和光栅化都在这里做，GUI 线程只贴最新算完的一帧。
+  // 任务只留最新的一个，没来得及算的旧任务直接作废；
+  // 算完的帧经 done 队列交给 GUI，GUI 换下来的帧经 free 队列还回来，
+  // frameNum 块画布轮流用，交接不加锁也不分配内存
+public:
+  using Job = std::function<void(Board&)>;
+
+  struct Frame{
+    Canvas canvas;
+    double computeMs = 0, rasterMs = 0; // 这一帧 drawPoly 和光栅化各自的用时
+    long allocs = 0; // 这一帧 drawPoly 和光栅化里的内存分配次数，只有 Profiler::enabled 并且编进了 alloc_count.cpp 时才有
+    uint64_t seq = 0; // 按第几个任务算的，和 submittedCount() 比就知道是不是最新的
+    std::array<double, Profiler::StageNum > stageMs{}; // 各阶段的用时，只有 Profiler::enabled 时才有
+    size_t figures = 0; // 这一帧的 Figure 个数
+    long pixels = 0; // 这一帧画的像素数
+    vector<Rect > dirty; // 和计算线程的上一帧相比变了的区域
+  };
+
+  // notify 在计算线程里调用，通知 GUI 有新帧了
+  explicit RenderThread(std::function<void()> _notify) : notify{std::move(_notify)} {
+    for(auto& frame : frames){
+      freeFrames.push(&frame);
+    }
+    worker = std::thread([this]{ loop(); });
+  }
+
+  ~RenderThread(){
+    {
+      std::lock_guard<std::mutex > lock(mu);
+      quit = true;
+    }
+    cv.notify_one();
+    worker.join();
+  }
+
+  // GUI 线程：提交新任务，画布大小 ww x hh
+  void submit(Job job, int ww, int hh){
+    TraceSpan span("submit", submitted + 1);
+    {
+      std::lock_guard<std::mutex > lock(mu);
+      lastJob = std::move(job);
+      jobW = ww;
+      jobH = hh;
+      jobSeq = ++ submitted;
+      hasJob = true;
+    }
+    Trace::flow("job", 's', submitted);
+    cv.notify_one();
+  }
+
+  // GUI 线程：窗口大小变了，按新大小把上一个任务再算一遍；改大小的过程中不要每一步都调，等停下来再调
+  void resize(int ww, int hh){
+    TraceSpan span("submit", submitted + 1);
+    {
+      std::lock_guard<std::mutex > lock(mu);
+      if(submitted == 0 || (jobW == ww && jobH == hh)){
+        return;
+      }
+      jobW = ww;
+      jobH = hh;
+      jobSeq = ++ submitted;
+      hasJob = true;
+    }
+    Trace::flow("job", 's', submitted);
+    cv.notify_one();
+  }
+
+  // GUI 线程：到现在一共提交过几个任务（改大小重算也算一个）
+  uint64_t submittedCount() const { return submitted; }
+
+  // GUI 线程：换成最新算完的一帧，积压的旧帧直接还回去，有新帧时返回 true
+  // 跳过的帧的脏区域也要并进来，dirty() 是相对上次 acquire 到的帧变了的区域
+  bool acquire(){
+    Frame* frame;
+    bool fresh = false;
+    while(doneFrames.pop(frame)){
+      if(!fresh){
+        dirtyRects.clear();
+      }
+      dirtyRects.insert(dirtyRects.end(), frame -> dirty.begin(), frame -> dirty.end());
+      if(current){
+        freeFrames.push(current);
+      }
+      current = frame;
+      fresh = true;
+    }
+    if(fresh){
+      // 计算线程可能正等着空闲的画布；先拿一下锁，保证它要么还没检查，要么已经在等了
+      { std::lock_guard<std::mutex > lock(mu); }
+      cv.notify_one();
+    }
+    return fresh;
+  }
+
+  // GUI 线程：当前要贴的帧，还没算出过任何一帧时是 nullptr
+  const Frame* latest() const { return current; }
+
+  // GUI 线程：最近一次 acquire 换上的帧要重绘的区域
+  const vector<Rect >& dirty() const { return dirtyRects; }
+
+private:
+  static constexpr int frameNum = 3; // GUI 正在贴的、排队等贴的、正在算的
+
+  void loop(){
+    Trace::nameThread("render");
+    Profiler::pipelineThread = true;
+    Board board; // 只在计算线程里用
+    Job job; // 最近算的任务，改大小时拿它重算；新任务是移过来的，不拷贝捕获的数据
+    while(true){
+      int ww, hh;
+      uint64_t seq;
+      Frame* frame = nullptr;
+      {
+        std::unique_lock<std::mutex > lock(mu);
+        cv.wait(lock, [&]{ return quit || (hasJob && freeFrames.pop(frame)); });
+        if(quit){
+          return;
+        }
+        if(lastJob){
+          job = std::move(lastJob);
+          lastJob = nullptr;
+        }
+        ww = jobW;
+        hh = jobH;
+        seq = jobSeq;
+        hasJob = false;
+      }
+      using clock = std::chrono::steady_clock;
+      TraceSpan span("frame", seq);
+      Trace::flow("job", 't', seq); // 被新任务顶掉的任务只有提交，箭头断在那里
+      Profiler::take(); // 上一帧之后零碎的计时不算进这一帧
+      long allocs = Profiler::allocs.load();
+      auto begin = clock::now();
+      board.resize(ww, hh);
+      {
+        TraceSpan span("drawPoly", seq);
+        job(board);
+      }
+      auto built = clock::now();
+      {
+        TraceSpan span("rasterize", seq);
+        frame -> canvas.resize(ww, hh);
+        board.scene.rasterize(frame -> canvas, board.pixelSize);
+      }
+      frame -> dirty = board.scene.dirtyRects();
+      frame -> computeMs = std::chrono::duration<double, std::milli >(built - begin).count();
+      frame -> rasterMs = std::chrono::duration<double, std::milli >(clock::now() - built).count();
+      frame -> seq = seq;
+      frame -> stageMs = Profiler::take();
+      frame -> allocs = Profiler::allocs.load() - allocs; // 工作线程的分配在 rasterize 返回之前都做完了
+      frame -> figures = board.scene.size();
+      frame -> pixels = board.scene.pixelCount();
+      doneFrames.push(frame);
+      notify();
+    }
+  }
+
+  Frame frames[frameNum];
+  SpscRing<Frame*, 4 > doneFrames; // 计算线程 -> GUI
+  SpscRing<Frame*, 4 > freeFrames; // GUI -> 计算线程
+  Frame* current = nullptr; // 只有 GUI 线程碰
+  vector<Rect > dirtyRects; // 只有 GUI 线程碰
+  uint64_t submitted = 0; // 只有 GUI 线程碰
+
+  std::mutex mu;
+  std::condition_variable cv;
+  Job lastJob; // 提交了、计算线程还没取走的任务
+  int jobW = 0, jobH = 0;
+  uint64_t jobSeq = 0;
+  bool hasJob = false, quit = false;
+
+  std::function<void()> notify;
+  std::thread worker; // 放在最后，其他成员都初始化好了才启动
+};
+
+struct FramePacer{
+  // 拖拽时鼠标移动事件来得比屏幕刷新快得多，每来一个就重算一遍只会越积越多。
+  // push 只记下最新的位置，帧定时器到了再 take 出来算一次，中间被覆盖的事件算作丢弃；
+  // presented 在画完之后调用，记录从这一帧用到的那个事件到画完的延迟
+  using clock = std::chrono::steady_clock;
+
+  void push(int _x, int _y){
+    events ++;
+    if(pending){
+      dropped ++;
+    }
+    pending = true;
+    x = _x;
+    y = _y;
+    latestAt = clock::now();
+  }
+
+  bool take(int& _x, int& _y){
+    if(!pending){
+      return false;
+    }
+    pending = false;
+    _x = x;
+    _y = y;
+    inFlight = true;
+    takenAt = latestAt;
+    return true;
+  }
+
+  // 还有移动没交给 take
+  bool waiting() const { return pending; }
+
+  void presented(){
+    if(!inFlight){
+      return;
+    }
+    inFlight = false;
+    double ms = std::chrono::duration<double, std::milli >(clock::now() - takenAt).count();
+    frames ++;
+    latencySum += ms;
+    latencyMax = max(latencyMax, ms);
+  }
+
+  // 打印这次拖拽的统计（拖的是空白处、一帧都没画的不打印），然后清零
+  void report(){
+    if(frames > 0){
+      cout << "drag: " << events << " moves, " << frames << " frames, " << dropped << " dropped"
+        << ", latency avg " << (frames ? latencySum / frames : 0) << " ms, max " << latencyMax << " ms" << endl;
+    }
+    *this = FramePacer{};
+  }
+
+private:
+  bool pending = false, inFlight = false;
+  int x = 0, y = 0;
+  clock::time_point latestAt, takenAt;
+  long events = 0, dropped = 0, frames = 0;
+  double latencySum = 0, latencyMax = 0;
+};
+
+struct InputLog{
+  // 一次交互的录制：按时间顺序的输入事件，存成紧凑的二进制文件，回放时原样再发给窗口。
+  // 文件头是 "CRVI" 加 1 个字节的版本号，之后每个事件是 1 个字节的类型和 4 个 zigzag varint：
+  // 距上一个事件的微秒数、a、b、c；鼠标坐标存的是和上一个鼠标事件的差，拖拽时一般各占 1 个字节
+  enum Type : uint8_t { Press = 1, Release, Move, Key, Wheel, Resize };
+
+  struct Event{
+    int64_t us = 0; // 从开始录制算起的微秒数
+    uint8_t type = 0;
+    // Press/Release：按键、x、y；Move：按着的键、x、y；Key：键值、修饰键；Wheel：滚动量、x、y；Resize：宽、高
+    int a = 0, b = 0, c = 0;
+  };
+
+  static constexpr char magic[5] = "CRVI";
+  static constexpr uint8_t version = 1;
+
+  static bool hasPos(uint8_t type){
+    return type == Press || type == Release || type == Move || type == Wheel;
+  }
+
+  static void putVar(std::string& out, int64_t v){
+    uint64_t u = uint64_t(v) << 1 ^ uint64_t(v >> 63);
+    while(u >= 128){
+      out.push_back(char((u & 127) | 128));
+      u >>= 7;
+    }
+    out.push_back(char(u));
+  }
+
+  static bool getVar(std::istream& in, int64_t& v){
+    uint64_t u = 0;
+    for(int shift = 0; shift < 64; shift += 7){
+      int byte = in.get();
+      if(byte == EOF){
+        return false;
+      }
+      u |= uint64_t(byte & 127) << shift;
+      if(byte < 128){
+        v = int64_t(u >> 1) ^ -int64_t(u & 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static bool save(const vector<Event >& events, const std::string& path){
+    std::string out(magic, 4);
+    out.push_back(char(version));
+    int64_t us = 0;
+    int x = 0, y = 0;
+    for(auto& e : events){
+      out.push_back(char(e.type));
+      putVar(out, e.us - us);
+      putVar(out, e.a);
+      if(hasPos(e.type)){
+        putVar(out, e.b - x);
+        putVar(out, e.c - y);
+        x = e.b;
+        y = e.c;
+      }
+      else{
+        putVar(out, e.b);
+        putVar(out, e.c);
+      }
+      us = e.us;
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write(out.data(), out.size());
+    return bool(file);
+  }
+
+  // 文件打不开、不是这个格式或者中途截断时返回 false
+  static bool load(const std::string& path, vector<Event >& events){
+    std::ifstream in(path, std::ios::binary);
+    char head[5];
+    if(!in.read(head, 5) || std::memcmp(head, magic, 4) != 0 || uint8_t(head[4]) != version){
+      return false;
+    }
+    events.clear();
+    int64_t us = 0;
+    int x = 0, y = 0;
+    int type;
+    while((type = in.get()) != EOF){
+      int64_t dt, a, b, c;
+      if(type < Press || type > Resize || !getVar(in, dt) || !getVar(in, a) || !getVar(in, b) || !getVar(in, c)){
+        return false;
+      }
+      Event e;
+      e.us = us += dt;
+      e.type = type;
+      e.a = a;
+      if(hasPos(e.type)){
+        e.b = x += b;
+        e.c = y += c;
+      }
+      else{
+        e.b = b;
+        e.c = c;
+      }
+      events.push_back(e);
+    }
+    return true;
+  }
+};
+
+struct LatencyStats{
+  // 回放时的统计：每一帧的计算、光栅化、贴图用时，以及每个输入事件到画面出来的延迟，单位都是毫秒
+  vector<double > compute, raster, paint, latency;
+
+  // 最近秩法的百分位数，空的时候是 0
+  static double percentile(vector<double > v, double p){
+    if(v.empty()){
+      return 0;
+    }
+    std::sort(v.begin(), v.end());
+    size_t k = size_t(std::ceil(p * v.size()));
+    return v[min(max(k, size_t(1)), v.size()) - 1];
+  }
+
+  void print(std::ostream& out) const {
+    auto line = [&](const char* name, const vector<double >& v){
+      out << "  " << name << percentile(v, 0.5) << " / " << percentile(v, 0.99) << " / " << percentile(v, 1) << " ms" << endl;
+    };
+    out << "  p50 / p99 / max over " << compute.size() << " frames, " << latency.size() << " events" << endl;
+    line("compute: ", compute);
+    line("raster:  ", raster);
+    line("paint:   ", paint);
+    line("latency: ", latency);
+  }
+};
+
+struct RollingHistogram{
+  // 最近 capacity 个样本（毫秒）的滚动直方图，桶按 2 的幂分：
+  // [0, 1/8)、[1/8, 1/4)、…、[16, 32)、[32, +inf)，旧样本挤出去时从它的桶里减掉
+  static constexpr int capacity = 240, bucketNum = 10;
+
+  static int bucket(double ms){
+    if(ms < 0.125){
+      return 0;
+    }
+    return min(bucketNum - 1, 1 + int(std::floor(std::log2(ms / 0.125))));
+  }
+
+  void push(double ms){
+    if(size == capacity){
+      counts[bucket(samples[head])] --;
+    }
+    else{
+      size ++;
+    }
+    samples[head] = ms;
+    counts[bucket(ms)] ++;
+    head = (head + 1) % capacity;
+  }
+
+  bool empty() const { return size == 0; }
+  double last() const { return size ? samples[(head + capacity - 1) % capacity] : 0; }
+  // 和 LatencyStats::percentile 一样是最近秩法，样本拷到 scratch 里用 nth_element 找，不分配内存
+  double percentile(double p) const {
+    if(size == 0){
+      return 0;
+    }
+    std::copy(samples.begin(), samples.begin() + size, scratch.begin());
+    int k = min(max(int(std::ceil(p * size)), 1), size) - 1;
+    std::nth_element(scratch.begin(), scratch.begin() + k, scratch.begin() + size);
+    return scratch[k];
+  }
+  const std::array<int, bucketNum >& buckets() const { return counts; }
+
+private:
+  std::array<double, capacity > samples{};
+  mutable std::array<double, capacity > scratch{}; // percentile 用
+  std::array<int, bucketNum > counts{};
+  int size = 0, head = 0;
+};
+
+struct LineBench{
+  // 对比几种线段光栅化的吞吐：原来逐像素做除法的写法、增量 DDA、批量版本
+  // 用法：codeN --bench-line
+  // 单核 Xeon（有 AVX-512）上默认编译量的，每种取 20 轮里最快的，批量版本相对原来的写法：
+  //   ~512px 的段快 2 ~ 3 倍，sampled 快 1.2 ~ 1.7 倍，~32px 快一成左右，~4px 差不多（上下一成）
+  // ~4px 的段大多走 appendShort，和原来的写法一样逐方块做除法，只多了判断在不在画布和这几行里；
+  // 只有 AVX2 的机器上批量版本对长段也就和原来差不多
+  static void reference(int x0, int y0, int x1, int y1, int pixelSize, PaintList& list){
+    using std::swap;
+    if(abs(x0 - x1) >= abs(y0 - y1)){
+      if(x0 > x1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      int len = x1 - x0 + 1;
+      for(int x = x0; x <= x1; x += pixelSize){
+        list.push(x, (y0 * (x1 - x) + y1 * (x - x0 + 1)) / len);
+      }
+    }
+    else{
+      if(y0 > y1){
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      int len = y1 - y0 + 1;
+      for(int y = y0; y <= y1; y += pixelSize){
+        list.push((x0 * (y1 - y) + x1 * (y - y0 + 1)) / len, y);
+      }
+    }
+  }
+
+  static int run(){
+    const int ww = 2000, hh = 1000, rounds = 20;
+    // 随机游走的折线每段长度大约 segLen；sampled 是和 drawPoly 一样自适应采样再化简出来的三次曲线，拖动时画的就是这种
+    for(int segLen : {4, 32, 512, 0}){
+      for(int pixelSize : {1, 3}){
+        vector<pair<vecf, vecf > > lines;
+        if(segLen > 0){
+          vecf x{1000}, y{500};
+          for(int i = 0; i < (1 << 20) / segLen; i ++){
+            x.push_back(min(ww - 1.0f, max(0.0f, x.back() + float(rand() % (2 * segLen + 1) - segLen))));
+            y.push_back(min(hh - 1.0f, max(0.0f, y.back() + float(rand() % (2 * segLen + 1) - segLen))));
+          }
+          lines.emplace_back(x, y);
+        }
+        else{
+          AdaptiveSampler sampler;
+          Simplifier simplifier;
+          simplifier.tol = pixelSize * 0.25;
+          for(int c = 0; c < 512; c ++){
+            Vector2d p[4];
+            for(auto& v : p){
+              v = {rand() % ww, rand() % hh};
+            }
+            auto bezier = [&](double t){
+              double s = 1 - t;
+              return Vector2d(s * s * s * p[0] + 3 * s * s * t * p[1] + 3 * s * t * t * p[2] + t * t * t * p[3]);
+            };
+            vecf x, y;
+            sampler.sample(bezier, 0, 1, x, y);
+            simplifier.run(x, y);
+            lines.emplace_back(x, y);
+          }
+        }
+        long segments = 0;
+        for(auto& [x, y] : lines){
+          segments += x.size() - 1;
+        }
+        PaintList lists[3];
+        double ms[3];
+        for(int kernel = 0; kernel < 3; kernel ++){
+          ms[kernel] = 1e9;
+          for(int round = 0; round < rounds; round ++){
+            auto begin = std::chrono::steady_clock::now();
+            lists[kernel].reset(ww, hh, 0);
+            for(auto& [x, y] : lines){
+              int n = x.size();
+              if(kernel == 2){
+                Line::appendSegments(x.data(), y.data(), n, false, pixelSize, lists[kernel]);
+                continue;
+              }
+              for(int i = 0; i + 1 < n; i ++){
+                if(kernel == 0){
+                  reference(x[i], y[i], x[i + 1], y[i + 1], pixelSize, lists[kernel]);
+                }
+                else{
+                  Line::appendSegment(x[i], y[i], x[i + 1], y[i + 1], pixelSize, lists[kernel]);
+                }
+              }
+            }
+            // 取最快的一轮，机器上别的东西只会让它变慢
+            ms[kernel] = min(ms[kernel], std::chrono::duration<double, std::milli >(std::chrono::steady_clock::now() - begin).count());
+          }
+        }
+        bool same = lists[0].x == lists[1].x && lists[0].y == lists[1].y
+          && lists[0].x == lists[2].x && lists[0].y == lists[2].y;
+        double pixels = lists[0].size();
+        if(segLen > 0){
+          cout << "segment ~" << segLen << "px";
+        }
+        else{
+          cout << "sampled curves";
+        }
+        cout << ", pixelSize " << pixelSize << ", " << segments << " segments, "
+          << pixels << " pixels" << (same ? "" : "  MISMATCH") << endl;
+        const char* names[3] = {"reference", "incremental", "batch"};
+        for(int kernel = 0; kernel < 3; kernel ++){
+          cout << "  " << names[kernel] << ": " << ms[kernel] << " ms, "
+            << pixels / ms[kernel] / 1e3 << " Mpixel/s" << endl;
+        }
+      }
+    }
+    return 0;
+  }
+};
+
+struct Headless{
+  // 无界面模式，不需要 Qt 也不需要显示器：
+  //   codeN --headless points.txt [out.ppm|out.png] [--size 2000x1000] [--view X,Y,SCALE] [--no-simplify] [--pixel-size N] [--threads N] [--trace out.json]
+  // points.txt 每行一个控制点 "x y"，空行隔开不同的配置，# 开头的行是注释。
+  // 每个配置都走一遍和窗口里一样的 Board::drawPoly 和光栅化，最后打印耗时；
+  // 给了输出文件就把每个配置的图存下来，不止一个配置时文件名后面加上序号
+  // --view 是画布左上角的世界坐标和缩放倍数，默认 0,0,1；--no-simplify 关掉折线化简，和默认的结果、耗时对比用
+  // --pixel-size 默认和窗口一样是 3，给 1 就是全分辨率抗锯齿；--threads 是光栅化用几个线程（连调用线程），默认每个核一个，
+  // 看多核加速比用；--trace 由 main 里的 TraceSession 处理，这里跳过
+  using Points = vector<pair<float, float > >;
+
+  static vector<Points > load(const std::string& path){
+    vector<Points > configs(1);
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)){
+      std::istringstream ss(line);
+      float x, y;
+      if(ss >> x >> y){
+        configs.back().emplace_back(x, y);
+      }
+      else if(line.find_first_not_of(" \t\r") == std::string::npos && !configs.back().empty()){
+        configs.emplace_back();
+      }
+    }
+    if(configs.back().empty()){
+      configs.pop_back();
+    }
+    return configs;
+  }
+
+  // PNG 里的整数都是大端的 4 个字节
+  static void putU32(std::string& out, uint32_t v){
+    for(int shift = 24; shift >= 0; shift -= 8){
+      out.push_back(char(v >> shift & 255));
+    }
+  }
+
+  static uint32_t crc32(const char* data, size_t bytes, uint32_t crc = 0){
+    static const auto table = []{
+      std::array<uint32_t, 256 > t{};
+      for(uint32_t i = 0; i < 256; i ++){
+        uint32_t c = i;
+        for(int k = 0; k < 8; k ++){
+          c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        t[i] = c;
+      }
+      return t;
+    }();
+    crc = ~crc;
+    for(size_t i = 0; i < bytes; i ++){
+      crc = table[(crc ^ uint8_t(data[i])) & 255] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+  // 一个 chunk：长度、类型、数据、类型和数据的 CRC
+  static void putChunk(std::ostream& out, const char* type, const std::string& data){
+    std::string chunk;
+    putU32(chunk, data.size());
+    chunk.append(type, 4);
+    chunk += data;
+    putU32(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    out.write(chunk.data(), chunk.size());
+  }
+
+  // 不依赖 Qt 和 zlib 的 PNG：RGBA、每行不做滤波，deflate 只用不压缩的块，所以文件和 PPM 差不多大。
+  // 画布是预乘过的，存之前除回去
+  static bool savePng(const Canvas& canvas, const std::string& path){
+    int ww = canvas.width(), hh = canvas.height();
+    std::string raw; // 每行一个滤波类型字节（0）加 ww 个 RGBA
+    raw.reserve(size_t(ww * 4 + 1) * hh);
+    for(int j = 0; j < hh; j ++){
+      raw.push_back(0);
+      const uint32_t* p = canvas.data() + size_t(j) * ww;
+      for(int i = 0; i < ww; i ++){
+        uint32_t a = p[i] >> 24;
+        for(int shift : {16, 8, 0}){
+          raw.push_back(char(a ? ((p[i] >> shift & 255) * 255 + a / 2) / a : 0));
+        }
+        raw.push_back(char(a));
+      }
+    }
+
+    std::string zlib = "\x78\x01"; // deflate，窗口 32K，不压缩
+    uint32_t s1 = 1, s2 = 0; // Adler-32
+    for(size_t begin = 0; begin < raw.size(); begin += 65535){
+      size_t len = min(raw.size() - begin, size_t(65535));
+      zlib.push_back(begin + len == raw.size() ? 1 : 0); // 最后一块置 BFINAL
+      for(uint32_t v : {uint32_t(len), uint32_t(~len & 0xffff)}){
+        zlib.push_back(char(v & 255));
+        zlib.push_back(char(v >> 8 & 255));
+      }
+      zlib.append(raw, begin, len);
+      for(size_t i = begin; i < begin + len; i ++){
+        s1 = (s1 + uint8_t(raw[i])) % 65521;
+        s2 = (s2 + s1) % 65521;
+      }
+    }
+    putU32(zlib, s2 << 16 | s1);
+
+    std::string header;
+    putU32(header, ww);
+    putU32(header, hh);
+    header += std::string("\x08\x06\x00\x00\x00", 5); // 8 位，RGBA，默认压缩、滤波，不隔行
+    std::ofstream out(path, std::ios::binary);
+    out.write("\x89PNG\r\n\x1a\n", 8);
+    putChunk(out, "IHDR", header);
+    putChunk(out, "IDAT", zlib);
+    putChunk(out, "IEND", "");
+    return bool(out);
+  }
+
+  // .png 存成 PNG，其他一律写二进制 PPM
+  static bool save(const Canvas& canvas, const std::string& path){
+    int ww = canvas.width(), hh = canvas.height();
+    if(path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0){
+      return savePng(canvas, path);
+    }
+    std::ofstream out(path, std::ios::binary);
+    out << "P6\n" << ww << " " << hh << "\n255\n";
+    vector<unsigned char > row(size_t(ww) * 3);
+    for(int j = 0; j < hh; j ++){
+      const uint32_t* p = canvas.data() + size_t(j) * ww;
+      for(int i = 0; i < ww; i ++){
+        row[i * 3] = p[i] >> 16 & 255;
+        row[i * 3 + 1] = p[i] >> 8 & 255;
+        row[i * 3 + 2] = p[i] & 255;
+      }
+      out.write(reinterpret_cast<const char* >(row.data()), row.size());
+    }
+    return bool(out);
+  }
+
+  // out.ppm -> out_3.ppm
+  static std::string numbered(const std::string& path, size_t i){
+    size_t dot = path.rfind('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)){
+      dot = path.size();
+    }
+    return path.substr(0, dot) + "_" + std::to_string(i) + path.substr(dot);
+  }
+
+  template<class Board, class Poly >
+  static int run(int argc, char** argv){
+    std::string pointsPath, outPath;
+    int ww = 2000, hh = 1000;
+    bool simplify = true;
+    int pixelSize = 3;
+    Viewport view;
+    for(int i = 2; i < argc; i ++){
+      std::string arg = argv[i];
+      if(arg == "--size" && i + 1 < argc){
+        if(std::sscanf(argv[++ i], "%dx%d", &ww, &hh) != 2 || ww <= 0 || hh <= 0){
+          std::cerr << "bad --size, expected WWxHH" << endl;
+          return 1;
+        }
+      }
+      else if(arg == "--view" && i + 1 < argc){
+        if(std::sscanf(argv[++ i], "%lf,%lf,%lf", &view.x, &view.y, &view.scale) != 3 || !(view.scale > 0)){
+          std::cerr << "bad --view, expected X,Y,SCALE" << endl;
+          return 1;
+        }
+      }
+      else if(arg == "--no-simplify"){
+        simplify = false;
+      }
+      else if(arg == "--pixel-size" && i + 1 < argc){
+        if(std::sscanf(argv[++ i], "%d", &pixelSize) != 1 || pixelSize <= 0){
+          std::cerr << "bad --pixel-size, expected a positive integer" << endl;
+          return 1;
+        }
+      }
+      else if(arg == "--threads" && i + 1 < argc){
+        int threads;
+        if(std::sscanf(argv[++ i], "%d", &threads) != 1 || threads <= 0){
+          std::cerr << "bad --threads, expected a positive integer" << endl;
+          return 1;
+        }
+        WorkerPool::defaultNum = threads - 1;
+      }
+      else if(arg == "--trace" && i + 1 < argc){
+        i ++;
+      }
+      else if(pointsPath.empty()){
+        pointsPath = arg;
+      }
+      else{
+        outPath = arg;
+      }
+    }
+    if(pointsPath.empty()){
+      std::cerr << "usage: " << argv[0] << " --headless points.txt [out.ppm|out.png] [--size 2000x1000] [--view X,Y,SCALE] [--no-simplify] [--pixel-size N] [--threads N] [--trace out.json]" << endl;
+      return 1;
+    }
+
+    auto configs = load(pointsPath);
+    if(configs.empty()){
+      std::cerr << "no control points in " << pointsPath << endl;
+      return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::duration d){ return std::chrono::duration<double, std::milli >(d).count(); };
+    Board board;
+    board.resize(ww, hh);
+    board.simplifier.enabled = simplify;
+    board.pixelSize = pixelSize;
+    board.view = view;
+    Canvas canvas;
+    canvas.resize(ww, hh);
+    double buildMs = 0, rasterMs = 0, saveMs = 0;
+    // 全局 operator new 的次数，只数后一半配置：前面的要把 arena、缓冲区、CurveMemo 撑到够用
+    size_t warmup = max(configs.size() / 2, size_t(1));
+    long buildAllocs = 0, rasterAllocs = 0;
+#ifdef CURVE_COUNT_ALLOCS
+    Profiler::enabled = true;
+    Profiler::pipelineThread = true;
+#endif
+    for(size_t i = 0; i < configs.size(); i ++){
+      TraceSpan span("config", i);
+      auto begin = clock::now();
+      Poly poly;
+      for(auto& [x, y] : configs[i]){
+        poly.add(x, y);
+      }
+      long allocs = Profiler::allocs;
+      {
+        TraceSpan span("drawPoly", i);
+        board.drawPoly(poly);
+      }
+      auto built = clock::now();
+      long allocsBuilt = Profiler::allocs;
+      {
+        TraceSpan span("rasterize", i);
+        board.scene.rasterize(canvas, board.pixelSize);
+      }
+      auto drawn = clock::now();
+      if(i >= warmup){
+        buildAllocs += allocsBuilt - allocs;
+        rasterAllocs += Profiler::allocs - allocsBuilt;
+      }
+      buildMs += ms(built - begin);
+      rasterMs += ms(drawn - built);
+      if(!outPath.empty()){
+        std::string path = configs.size() == 1 ? outPath : numbered(outPath, i);
+        TraceSpan span("save", i);
+        if(!save(canvas, path)){
+          std::cerr << "cannot write " << path << endl;
+          return 1;
+        }
+        saveMs += ms(clock::now() - drawn);
+      }
+    }
+
+    double n = configs.size();
+    cout << configs.size() << " configs, " << ww << "x" << hh << endl;
+    cout << "  drawPoly:  " << buildMs / n << " ms/config" << endl;
+    cout << "  rasterize: " << rasterMs / n << " ms/config" << endl;
+    if(!outPath.empty()){
+      cout << "  save:      " << saveMs / n << " ms/config" << endl;
+    }
+    cout << "  " << n / ((buildMs + rasterMs) / 1e3) << " configs/s (without save)" << endl;
+#ifdef CURVE_COUNT_ALLOCS
+    if(configs.size() > warmup){
+      double steady = configs.size() - warmup;
+      cout << "  allocs:    " << buildAllocs / steady << " in drawPoly, " << rasterAllocs / steady
+        << " in rasterize per config (last " << configs.size() - warmup << " configs)" << endl;
+    }
+#endif
+    cout << "  curve memo: " << board.memo.hitCount() << " hits, " << board.memo.missCount() << " misses" << endl;
+    long before = board.simplifier.beforeCount(), after = board.simplifier.afterCount();
+    if(before > 0){
+      cout << "  simplify:  " << before << " -> " << after << " points (" << double(before) / max(after, 1L) << "x)"
+        << (simplify ? "" : ", disabled") << endl;
+    }
+    return 0;
+  }
+};
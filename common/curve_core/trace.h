@@ -0,0 +1,211 @@
+#pragma once
+// 导出 Chrome trace-event JSON，chrome://tracing 和 ui.perfetto.dev 都能打开，不依赖 Qt：
+//   codeN --trace out.json ...   其他参数照旧，退出时把记下的事件写进 out.json
+// 能看到 GUI、计算线程和工作线程各自在做什么、什么时候重叠、哪里在等，
+// 每个任务从提交、计算到贴出来用箭头连着，慢的帧一眼就能看出来卡在哪一步。
+// 没开 --trace 时 TraceSpan 只读一次原子变量；开了以后每个线程往自己的缓冲里追加，不加锁
+#include "base.h"
+
+struct Trace{
+  // 每个线程一个 Buffer，由一串固定大小的 Chunk 组成：只有自己的线程往里写，写完一条把 size 往后挪（release），
+  // 写满了挂一个新块。写文件的线程按 size（acquire）读，不用等写的线程停下来。
+  // Buffer 和 Chunk 在程序退出之前都不释放，线程退出以后记下的事件还在
+  using clock = std::chrono::steady_clock;
+
+  struct Event{
+    const char* name; // 只存指针，都是字符串字面量
+    char phase; // 'X' 一段区间；'s' 'f' 是把一个任务的提交、计算、贴图连起来的箭头（'t' 是中间经过的点）
+    int64_t begin, dur; // 相对 epoch 的纳秒
+    int64_t arg; // 任务序号，小于 0 表示没有
+  };
+
+  struct Chunk{
+    static constexpr int capacity = 4096;
+    Event events[capacity];
+    std::atomic<int > size{0};
+    std::atomic<Chunk* > next{nullptr};
+  };
+
+  struct Buffer{
+    int tid;
+    const char* name = nullptr;
+    Chunk head;
+    Chunk* tail = &head; // 只有自己的线程碰
+  };
+
+  static constexpr long maxChunks = 1024; // 最多记 400 万个事件（160MB），再多就丢掉，写文件时报一下丢了多少
+
+  inline static std::atomic<bool > enabled{false};
+  inline static clock::time_point epoch = clock::now();
+  inline static std::mutex mu; // 只在线程第一次记事件、起名字和写文件时用
+  inline static vector<std::unique_ptr<Buffer > > buffers;
+  inline static std::atomic<long > chunks{0};
+  inline static std::atomic<long > dropped{0};
+  inline static thread_local Buffer* local = nullptr;
+
+  static bool on(){
+    return enabled.load(std::memory_order_relaxed);
+  }
+
+  static int64_t now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds >(clock::now() - epoch).count();
+  }
+
+  static void start(){
+    epoch = clock::now();
+    enabled = true;
+  }
+
+  // 给当前线程起个名字，在 trace 里显示成这一行的标题
+  static void nameThread(const char* name){
+    if(!on()){
+      return;
+    }
+    Buffer* b = buffer();
+    std::lock_guard<std::mutex > lock(mu);
+    b -> name = name;
+  }
+
+  static void record(const char* name, char phase, int64_t begin, int64_t dur, int64_t arg = -1){
+    Buffer* b = buffer();
+    Chunk* c = b -> tail;
+    int n = c -> size.load(std::memory_order_relaxed);
+    if(n == Chunk::capacity){
+      if(chunks.fetch_add(1, std::memory_order_relaxed) >= maxChunks){
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      Chunk* fresh = new Chunk;
+      c -> next.store(fresh, std::memory_order_release);
+      b -> tail = c = fresh;
+      n = 0;
+    }
+    c -> events[n] = {name, phase, begin, dur, arg};
+    c -> size.store(n + 1, std::memory_order_release);
+  }
+
+  // 箭头上的一个点，要落在当前线程某个 TraceSpan 里面
+  static void flow(const char* name, char phase, int64_t id){
+    if(on()){
+      record(name, phase, now(), 0, id);
+    }
+  }
+
+  // 写成 Chrome trace-event JSON，时间单位是微秒
+  static bool save(const std::string& path){
+    std::ofstream out(path);
+    std::lock_guard<std::mutex > lock(mu);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    bool first = true;
+    auto put = [&]{
+      out << (first ? "" : ",\n") << line;
+      first = false;
+    };
+    long count = 0;
+    for(auto& b : buffers){
+      if(b -> name){
+        std::snprintf(line, sizeof(line), "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+          b -> tid, b -> name);
+        put();
+      }
+      for(const Chunk* c = &b -> head; c; c = c -> next.load(std::memory_order_acquire)){
+        int n = c -> size.load(std::memory_order_acquire);
+        for(int i = 0; i < n; i ++){
+          const Event& e = c -> events[i];
+          int len = std::snprintf(line, sizeof(line), "{\"ph\":\"%c\",\"name\":\"%s\",\"cat\":\"curve\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+            e.phase, e.name, b -> tid, e.begin / 1e3);
+          if(e.phase == 'X'){
+            len += std::snprintf(line + len, sizeof(line) - len, ",\"dur\":%.3f", e.dur / 1e3);
+            if(e.arg >= 0){
+              len += std::snprintf(line + len, sizeof(line) - len, ",\"args\":{\"seq\":%lld}", (long long)e.arg);
+            }
+          }
+          else{
+            // 箭头的终点接在包着它的那段区间上
+            len += std::snprintf(line + len, sizeof(line) - len, ",\"id\":%lld%s", (long long)e.arg, e.phase == 'f' ? ",\"bp\":\"e\"" : "");
+          }
+          std::snprintf(line + len, sizeof(line) - len, "}");
+          put();
+          count ++;
+        }
+      }
+    }
+    out << "\n]}\n";
+    if(!out){
+      return false;
+    }
+    cout << "trace: " << count << " events from " << buffers.size() << " threads";
+    if(dropped > 0){
+      cout << ", " << dropped << " dropped (buffer full)";
+    }
+    cout << endl;
+    return true;
+  }
+
+private:
+  static Buffer* buffer(){
+    if(!local){
+      std::lock_guard<std::mutex > lock(mu);
+      buffers.push_back(std::make_unique<Buffer >());
+      local = buffers.back().get();
+      local -> tid = buffers.size();
+    }
+    return local;
+  }
+};
+
+class TraceSpan{
+  // 记一段区间，从构造到析构；name 要是字符串字面量这样一直有效的指针
+  const char* name;
+  int64_t arg;
+  int64_t begin = -1;
+
+public:
+  explicit TraceSpan(const char* _name, int64_t _arg = -1) : name{_name}, arg{_arg} {
+    if(Trace::on()){
+      begin = Trace::now();
+    }
+  }
+
+  ~TraceSpan(){
+    if(begin >= 0){
+      Trace::record(name, 'X', begin, Trace::now() - begin, arg);
+    }
+  }
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+class TraceSession{
+  // main 一开头建一个：命令行里有 --trace file.json 就开始记，析构时（main 返回）写文件。
+  // 它比窗口和计算线程先建、后析构，写文件时别的线程都已经停了
+  std::string path;
+
+public:
+  TraceSession(int argc, char** argv){
+    for(int i = 1; i + 1 < argc; i ++){
+      if(std::string(argv[i]) == "--trace"){
+        path = argv[i + 1];
+      }
+    }
+    if(!path.empty()){
+      Trace::start();
+      Trace::nameThread("main");
+    }
+  }
+
+  ~TraceSession(){
+    if(path.empty()){
+      return;
+    }
+    Trace::enabled = false;
+    if(!Trace::save(path)){
+      std::cerr << "cannot write " << path << endl;
+    }
+  }
+
+  TraceSession(const TraceSession&) = delete;
+  TraceSession& operator=(const TraceSession&) = delete;
+};
@@ -0,0 +1,611 @@
+#pragma once
+// 曲线的数学部分：插值、拟合、参数化、三次样条、Bezier、B 样条、细分，code1 ~ code7 的参考答案都在这里，不依赖 Qt。
+// 只有 参考 里的 code 和 curve_bench 链接它（CMake 里的 curve_math），code 目录下的骨架只链接 common 里的 curve_core
+// 除了逐点求值的 get，每种曲线还有对一组 t 成批求值的重载：只和控制点有关的准备工作（解方程、算系数、分配缓冲）
+// 在调用之前或者调用开头做一次，结果和逐点调用完全一样。成批的接口都是同一个样子，以后只改实现不改签名：
+//   控制点和参数用 const 引用传进来，t 是要求值的参数，结果写进 out（resize 成 t.size()），out 的内存可以跨调用复用
+// 解方程、细分这些每条曲线只做一次的计算在 --trace 里各记一段，逐点求值的不记
+#include "curve_core/base.h"
+#include "curve_core/trace.h"
+
+inline double gauss(double x, double mu, double sigma) {
+    return exp(-pow(x - mu, 2) / (2 * sigma * sigma));
+}
+
+struct Interpolation{
+  // code1、code2 的函数插值和拟合：x 是自变量，y 是函数值，Vec 是 vector<double > 或者 vecf
+
+  // 拉格朗日插值在 t 处的值
+  template<class Vec >
+  static double lagrange(const Vec& x, const Vec& y, double t){
+    assert(x.size() == y.size());
+    double result = 0.0;
+    int n = x.size();
+    for(int i = 0; i < n; i ++){
+      double term = y[i];
+      for(int j = 0; j < n; j ++){
+        if(j != i){
+          term *= (t - x[j]) / (x[i] - x[j]);
+        }
+      }
+      result += term;
+    }
+    return result;
+  }
+
+  template<class Vec >
+  static void lagrange(const Vec& x, const Vec& y, const vector<double >& t, vector<double >& out){
+    out.resize(t.size());
+    for(size_t k = 0; k < t.size(); k ++){
+      out[k] = lagrange(x, y, t[k]);
+    }
+  }
+
+  // n 个方差为 sigma、中心在 x[j] 的高斯函数对 (x, y) 插值，返回每个高斯函数的系数
+  template<class Vec >
+  static vector<double > gaussFit(const Vec& x, const Vec& y, double sigma){
+    TraceSpan span("gaussFit");
+    int n = x.size();
+    Eigen::MatrixXd A(n, n);
+
+    for(int i = 0; i < n; i ++){
+      for(int j = 0; j < n; j ++){
+        A(i, j) = gauss(x[i], x[j], sigma);
+      }
+    }
+
+    Eigen::VectorXd Y(n);
+    for(int i = 0; i < n; i ++){
+      Y[i] = y[i];
+    }
+    Eigen::VectorXd ret = A.partialPivLu().solve(Y);
+    return vector<double> (ret.data(), ret.data() + ret.size());
+  }
+
+  // gaussFit 得到的系数 b 在 t 处的值
+  template<class Vec >
+  static double getGauss(const Vec& x, const vector<double >& b, double t, double sigma){
+    double ret = 0;
+    for(size_t i = 0; i < x.size(); i ++){
+      ret += b[i] * gauss(t, x[i], sigma);
+    }
+    return ret;
+  }
+
+  template<class Vec >
+  static void getGauss(const Vec& x, const vector<double >& b, double sigma, const vector<double >& t, vector<double >& out){
+    out.resize(t.size());
+    for(size_t k = 0; k < t.size(); k ++){
+      out[k] = getGauss(x, b, t[k], sigma);
+    }
+  }
+
+  // 用 (x, y) 拟合 m 个系数的多项式，lamda 是岭回归系数；小的下标对应低次的系数
+  template<class Vec >
+  static vector<double > polynomialFit(const Vec& x, const Vec& y, int m, double lamda = 0){
+    TraceSpan span("polynomialFit");
+    int n = x.size();
+    Eigen::MatrixXd A(m, m);
+    for(int i = 0; i < m; i ++){
+      for(int j = 0; j < m; j ++){
+        double tmp = lamda;
+        for(int v = 0; v < n; v ++){
+          tmp += pow(x[v], i) * pow(x[v], j);
+        }
+        A(i, j) = tmp;
+      }
+    }
+
+    Eigen::VectorXd Y(m);
+    for(int i = 0; i < m; i ++){
+      double tmp = 0;
+      for(int v = 0; v < n; v ++){
+        tmp += pow(x[v], i) * y[v];
+      }
+      Y[i] = tmp;
+    }
+
+    Eigen::VectorXd ret = A.partialPivLu().solve(Y);
+    return vector<double> (ret.data(), ret.data() + ret.size());
+  }
+
+  // 秦九韶算法求多项式 a 在 t 处的值
+  static double getPoly(const vector<double >& a, double t){
+    int n = a.size();
+    double ret = 0;
+    for(int i = n - 1; i >= 0; i --){
+      ret = (ret * t + a[i]);
+    }
+    return ret;
+  }
+
+  static void getPoly(const vector<double >& a, const vector<double >& t, vector<double >& out){
+    out.resize(t.size());
+    for(size_t k = 0; k < t.size(); k ++){
+      out[k] = getPoly(a, t[k]);
+    }
+  }
+};
+
+struct Parameterization{
+  // 对曲线的时间做参数化，结果在 [0, 1]
+
+  // 按照欧氏距离参数化
+  static vector<float > distance(const vecf& x, const vecf& y){
+    int n = x.size();
+    assert(n >= 2);
+    assert(x.size() == y.size());
+    vecf t(n);
+
+    for(int i = 1; i < n; i ++){
+      t[i] = t[i - 1] + sqrt(pp(x[i] - x[i - 1]) + pp(y[i] - y[i - 1]));
+    }
+    for(int i = 1; i < n; i ++){
+      t[i] /= t.back();
+    }
+
+    return t;
+  }
+
+  // 平均参数化
+  static vector<float > average(const vecf& x, [[maybe_unused]] const vecf& y){
+    int n = x.size();
+    assert(n >= 2);
+    assert(x.size() == y.size());
+    vecf t(n);
+    for(int i = 0; i < n; i ++){
+      t[i] = (double)i / (n - 1);
+    }
+
+    return t;
+  }
+};
+
+struct B3{
+  // 自然边界的三次样条：先给 x、y，getB3() 算出每一段的系数，之后 get(t) 求值
+
+  vector<double > a, b, c, d; // [0, n - 1]
+  vecf x, y; // [0, n]
+  int p = 0;
+
+  void getB3(){
+    // y = ax^3 + bx^2 + cx + d，利用 x y 求出三次样条，把系数保存到 this -> a,b,c,d 中
+    TraceSpan span("getB3");
+    int n = x.size() - 1;
+    assert(x.size() == y.size());
+    a.resize(n);
+    b.resize(n);
+    c.resize(n);
+    d.resize(n);
+
+    /* 这里是用矩阵求解的方法，建议先尝试
+    cout << " n = " << n << endl;
+    Eigen::MatrixXd A(4 * n, 4 * n);
+    Eigen::VectorXd Y(4 * n);
+
+    for(int i = 0; i < n * 4; i ++){
+      for(int j = 0; j < n * 4; j ++){
+        A(i, j) = 0;
+      }
+    }
+
+    for(int i = 0, j = 0; i < n; i ++){
+      A(i, j ++) = ppp(x[i]);
+      A(i, j ++) = pp(x[i]);
+      A(i, j ++) = x[i];
+      A(i, j ++) = 1;
+    }
+
+    for(int i = 0, j = 0; i < n; i ++){
+      A(i + n, j ++) = ppp(x[i + 1]);
+      A(i + n, j ++) = pp(x[i + 1]);
+      A(i + n, j ++) = x[i + 1];
+      A(i + n, j ++) = 1;
+    }
+
+    {// S0''(x0) == 0
+     // 6a_0x_0 + 2b_0 == 0
+      A(n + n, 0) = 6 * x[0];
+      A(n + n, 1) = 2;
+
+      // S_{n - 1}''(x_n) == 0
+      // 6 a_{n - 1}x_{n - 1} + 2 b_{n - 1} == 0
+
+      A(n + n + n, (n - 1) << 2) = 6 * x[n];
+      A(n + n + n, (n - 1) << 2 | 1) = 2;
+    }
+
+    for(int i = 1, j1 = 0, j2 = 4; i < n; i ++){
+      int id = i + n + n;
+      A(id, j1 ++) = -3 * pp(x[i]);
+      A(id, j1 ++) = -2 * x[i];
+      A(id, j1 ++) = -1;
+      A(id, j1 ++) = 0;
+
+      A(id, j2 ++) = +3 * pp(x[i]);
+      A(id, j2 ++) = +2 * x[i];
+      A(id, j2 ++) = +1;
+      A(id, j2 ++) = 0;
+    }
+
+    for(int i = 1, j1 = 0, j2 = 4; i < n; i ++){
+      int id = i + n + n + n;
+      A(id, j1 ++) = -6 * x[i];
+      A(id, j1 ++) = -2;
+      A(id, j1 ++) = 0;
+      A(id, j1 ++) = 0;
+
+      A(id, j2 ++) = +6 * x[i];
+      A(id, j2 ++) = +2;
+      A(id, j2 ++) = 0;
+      A(id, j2 ++) = 0;
+    }
+
+
+    for(int i = 0; i < n; i ++){
+      Y[i] = y[i];
+      Y[i + n] = y[i + 1];
+      Y[i + n + n] = 0;
+      Y[i + n + n + n] = 0;
+    }
+
+    a.resize(n);
+    b.resize(n);
+    c.resize(n);
+    d.resize(n);
+
+    Eigen::VectorXd B = A.fullPivHouseholderQr().solve(Y);
+    for(int i = 0; i < n; i ++){
+      a[i] = B[i << 2];
+      b[i] = B[i << 2 | 1];
+      c[i] = B[i << 2 | 2];
+      d[i] = B[i << 2 | 3];
+    }
+    */
+
+
+    // 这里是线性的方法
+    vector<double > cc(n), cp(n), dd(n), dp(n);
+
+    for(int i = 0; i < n; i ++){
+      cc[i]  = - pp(x[i + 1] - x[i]) / 6;
+      cp[i] = y[i + 1];
+      dd[i]  = - pp(x[i + 1] - x[i]) / 6;
+      dp[i] = y[i    ];
+    }
+
+    Eigen::VectorXd m = Eigen::VectorXd::Zero(n + 1);
+    m[0] = m[n] = 0;
+
+    if(n > 1){
+      Eigen::VectorXd Y(n - 1);
+
+      for(int i = 0; i <= n - 2; i ++){
+        auto E = x[i + 2] - x[i + 1];
+        auto F = x[i + 1] - x[i];
+        Y[i] = (-cp[i] * E + dp[i] * E + cp[i + 1] * F - dp[i + 1] * F);
+      }
+
+      vector<double > _a(n - 1), _b(n - 1), _c(n - 1);
+      for(int i = 0; i <= n - 2; i ++){
+        auto E = x[i + 2] - x[i + 1];
+        auto F = x[i + 1] - x[i];
+
+        if(i != 0){
+          _a[i] = -dd[i] * E;
+        }
+
+        _b[i] = pp(x[i + 1] - x[i    ]) / 2.0 * E
+              + pp(x[i + 2] - x[i + 1]) / 2.0 * F
+              + (cc[i] * E + dd[i + 1] * F);
+
+        if(i != n - 2){
+          _c[i] = -cc[i + 1] * F;
+        }
+      }
+
+      for(int i = 1; i <= n - 2; i ++){
+        auto k = _a[i] / _b[i - 1];
+        _a[i] -= k * _b[i - 1];
+        _b[i] -= k * _c[i - 1];
+         Y[i] -= k *  Y[i - 1];
+      }
+
+      for(int i = 0; i <= n - 2; i ++){
+        assert(std::abs(_a[i]) < eps);
+      }
+
+      for(int i = n - 3; i >= 0; i --){
+        auto k = _c[i] / _b[i + 1];
+        _c[i] -= k * _b[i + 1];
+         Y[i] -= k *  Y[i + 1];
+      }
+
+      for(int i = 0; i <= n - 2; i ++){
+        assert(std::abs(_c[i]) < eps);
+      }
+
+      for(int i = 0; i <= n - 2; i ++){
+        m[i + 1] = Y[i] / _b[i];
+      }
+    }
+
+    Eigen::VectorXd C(n), D(n);
+
+    a.resize(n);
+    b.resize(n);
+    c.resize(n);
+    d.resize(n);
+
+    for(int i = 0; i < n; i ++){
+      C[i] = cc[i] * m[i + 1] + cp[i];
+      D[i] = dd[i] * m[i    ] + dp[i];
+
+      a[i] = (m[i + 1] / 6 * (+1)             + m[i] / 6 * (-1)                );
+      b[i] = (m[i + 1] / 6 * (-3 * x[i])      + m[i] / 6 * (+3 * x[i + 1])     );
+      c[i] = (m[i + 1] / 6 * (+3 * pp(x[i]))  + m[i] / 6 * (-3 * pp(x[i + 1])) ) + C[i] - D[i];
+      d[i] = (m[i + 1] / 6 * (-1 * ppp(x[i])) + m[i] / 6 * (+1 * ppp(x[i + 1])))
+           - x[i] * C[i] + x[i + 1] * D[i];
+
+
+      a[i] /= (x[i + 1] - x[i]);
+      b[i] /= (x[i + 1] - x[i]);
+      c[i] /= (x[i + 1] - x[i]);
+      d[i] /= (x[i + 1] - x[i]);
+    }
+  }
+
+  double get(double t){
+    // p 记着上次所在的段，两个方向都能走，自适应采样时 t 不是单调的
+    while(p != 0 && t < x[p]){
+      p --;
+    }
+    while(p != int(x.size()) - 2 && t > x[p + 1]){
+      p ++;
+    }
+    return a[p] * ppp(t) + b[p] * pp(t) + c[p] * t + d[p];
+  }
+
+  // t 按顺序给的时候 p 每次只走一两步
+  void get(const vector<double >& t, vector<double >& out){
+    out.resize(t.size());
+    for(size_t k = 0; k < t.size(); k ++){
+      out[k] = get(t[k]);
+    }
+  }
+};
+
+struct C{ // 组合数
+  // 杨辉三角每个线程一份，不同线程求值互不影响；用 double 存，n 大了只丢精度不溢出，过了 1029 才变成 inf
+  inline static thread_local vector< vector<double > > CC;
+  static void set(int nn){
+
+    if(nn + 1 <= int(CC.size())){
+      return ;
+    }
+
+    CC.resize(nn + 1);
+    for(int i = 0; i <= nn; i ++){
+      CC[i].resize(i + 2, 0);
+
+      CC[i][0] = 1;
+      for(int j = 1; j <= i; j ++){
+        CC[i][j] = CC[i - 1][j - 1] + CC[i - 1][j];
+      }
+    }
+  }
+
+  static double get(int n, int m){
+    if(n < 0 || m < 0 || m > n){
+      return 0;
+    }
+
+    set(n);
+    return CC[n][m];
+  }
+};
+
+struct Bernstein{
+  // 用定义计算 Bernstein 基函数
+  static double get(int n, int k, double t){
+    assert(0 <= k && k <= n);
+    return C::get(n, k) * pow(t, k) * pow(1 - t, n - k);
+  }
+};
+
+struct DeCasteljau{
+  // 每一轮把相邻的两个点按 t 插值，点数少一个，剩一个点就是结果
+  // 原地在 x 上算，调用方给的是一份拷贝
+  static double run(vecf& x, double t){
+    assert(!x.empty());
+    for(int m = x.size() - 1; m > 0; m --){
+      for(int i = 0; i < m; i ++){
+        x[i] = (1 - t) * x[i] + t * x[i + 1];
+      }
+    }
+    return x[0];
+  }
+
+  // 拷贝放在每个线程一份的缓冲里，求值不分配内存
+  static double get(const vecf& x, double t){
+    thread_local vecf buffer;
+    buffer.assign(x.begin(), x.end());
+    return run(buffer, t);
+  }
+
+  // scratch 是调用方留着复用的缓冲，放 x 的拷贝，容量够了就不再分配
+  static void get(const vecf& x, const vector<double >& t, vector<double >& out, vecf& scratch){
+    out.resize(t.size());
+    for(size_t k = 0; k < t.size(); k ++){
+      scratch.assign(x.begin(), x.end());
+      out[k] = run(scratch, t[k]);
+    }
+  }
+
+  // 不给 scratch 时用每个线程一份的缓冲
+  static void get(const vecf& x, const vector<double >& t, vector<double >& out){
+    thread_local vecf buffer;
+    get(x, t, out, buffer);
+  }
+};
+
+struct Bezier{
+  // x 是控制点的一个分量，t 在 [0, 1]，曲线怎么采样由 AdaptiveSampler 决定
+  // 用 De Casteljau 算法；直接用 Bernstein 求和在点多的时候误差大
+  static double get(const vecf& x, double t){
+    return DeCasteljau::get(x, t);
+  }
+
+  static void get(const vecf& x, const vector<double >& t, vector<double >& out){
+    DeCasteljau::get(x, t, out);
+  }
+
+  static void get(const vecf& x, const vector<double >& t, vector<double >& out, vecf& scratch){
+    DeCasteljau::get(x, t, out, scratch);
+  }
+};
+
+struct B_spline{
+  // 均匀节点的 B 样条：m 个控制点、K 阶，节点间隔 dt = 1 / (m + K - 1)，t 的 [0, 1] 对应到有效的那一段
+
+  // t 时平面上每个点对应的 N，放在每个线程一份的缓冲里，到下一次调用之前有效
+  static const vecf& basis(int K, double t, int m){
+    int n = m - 1;
+    double dt = 1.0 / (m + K - 1);
+
+    t = (K - 1) * dt + (m - K + 1) * dt * t;
+    // 递推只用到第 1 ~ K 阶，缓冲只增不减
+    thread_local vector<vecf > B;
+    if(int(B.size()) < K + 1){
+      B.resize(K + 1);
+    }
+    for(int k = 1; k <= K; k ++){
+      B[k].assign(n + K + 2, 0);
+    }
+
+    for(int i = 0; i < m + K - 1; i ++){
+      if(dt * i <= t && t < dt * (i + 1)){
+        B[1][i] = 1;
+      }
+      else{
+        B[1][i] = 0;
+      }
+    }
+
+    for(int k = 2; k <= K; k ++){
+      for(int j = 0; j <= m + K - 1 - k; j ++){
+        B[k][j]
+          = (t - dt * j)       / (dt * (j + k - 1) - dt * j)       * B[k - 1][j]
+          + (dt * (j + k) - t) / (dt * (j + k)     - dt * (j + 1)) * B[k - 1][j + 1];
+      }
+    }
+
+    return B[K];
+  }
+
+  static vecf getNvec(int K, double t, int m){
+    return basis(K, t, m);
+  }
+
+  static float getN(int J, int K, double t, int m){
+    return basis(K, t, m).at(J);
+  }
+
+  // t 时的坐标，x 是控制点的一个分量，t 在 [0, 1]
+  static double get(const vecf& x, int k, double t){
+
+    if(k > int(x.size())){
+      k = x.size();
+    }
+    // 节点区间左闭右开，t = 1 正好落在最后一段外面，往里收一点
+    t = std::min(t, 1 - 1e-9);
+    const vecf& Nvec = basis(k, t, x.size());
+
+    double xx = 0;
+    for(int i = 0; i < int(x.size()); i ++){
+      xx += x[i] * Nvec[i];
+    }
+    return xx;
+  }
+
+  static void get(const vecf& x, int k, const vector<double >& t, vector<double >& out){
+    out.resize(t.size());
+    for(size_t j = 0; j < t.size(); j ++){
+      out[j] = get(x, k, t[j]);
+    }
+  }
+};
+
+struct CurveSubdivision{
+  // 闭合多边形的细分，v 是顶点的一个分量，细分 t 次，每次点数翻倍
+
+  // Chaiukin 方法（二次 B 样条）逼近
+  static vecf make2B(const vecf& v, int t){
+    if(t <= 0){
+      return v;
+    }
+    TraceSpan span("make2B");
+
+    int n = v.size();
+    vecf ret(n * 2);
+
+    for(int i = 0; i < n; i ++){
+      ret[2 * i] = (v[(i - 1 + n) % n] + 3 * v[i]) / 4;
+      ret[2 * i + 1] = (3 * v[i] + v[(i + 1) % n]) / 4;
+    }
+
+    if(t == 1){
+      return ret;
+    }
+    else{
+      return make2B(ret, t - 1);
+    }
+  }
+
+  // 三次 B 样条逼近
+  static vecf make3B(const vecf& v, int t){
+    if(t <= 0){
+      return v;
+    }
+    TraceSpan span("make3B");
+    int n = v.size();
+    vecf ret(n * 2);
+
+    for(int i = 0; i < n; i ++){
+      ret[2 * i] = (v[(i - 1 + n) % n] + 6 * v[i] + v[(i + 1) % n]) / 8;
+      ret[2 * i + 1] = (4 * v[i] + 4 * v[(i + 1) % n]) / 8;
+    }
+
+    if(t == 1){
+      return ret;
+    }
+    else{
+      return make3B(ret, t - 1);
+    }
+  }
+
+  // 4 点插值细分
+  static vecf make4F(const vecf& v, int t){
+    if(t <= 0){
+      return v;
+    }
+    TraceSpan span("make4F");
+
+    const double alpha = 0.125;
+    int n = v.size();
+    vecf ret(n * 2);
+
+    for(int i = 0; i < n; i ++){
+      ret[2 * i] = v[i];
+      ret[2 * i + 1] = (v[i] + v[(i + 1) % n]) / 2 +
+        alpha * ((v[i] + v[(i + 1) % n]) / 2 - (v[(i - 1 + n) % n] + v[(i + 2) % n]) / 2);
+    }
+
+    if(t == 1){
+      return ret;
+    }
+    else{
+      return make4F(ret, t - 1);
+    }
+  }
+};